@@ -0,0 +1,1237 @@
+#include "lsm.h"
+#include "lsm_async.h"
+#include "lsm_dynamic.h"
+#include "lsm_fleet.h"
+#include "lsm_journal.h"
+#include "lsm_lexer.h"
+#include "lsm_queue.h"
+#include "lsm_runtime.h"
+#include "lsm_snapshot.h"
+#include "lsm_stats.h"
+#include "lsm_timer.h"
+#include "lsm_wire.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//--------------------------------------------------------
+// Benchmark machine
+//--------------------------------------------------------
+
+template <typename DispatchPolicy,
+          typename ErrorPolicy = lsm::policies::function_error,
+          typename InstrumentationPolicy = lsm::policies::no_instrumentation>
+struct sampler : lsm::state_machine_desc<
+                     sampler<DispatchPolicy, ErrorPolicy, InstrumentationPolicy>> {
+  using base = lsm::state_machine_desc<
+      sampler<DispatchPolicy, ErrorPolicy, InstrumentationPolicy>>;
+
+  // states
+  struct idle {};
+  struct running {};
+
+  // inputs
+  struct start {};
+  struct stop {};
+  struct sample {
+    std::uint32_t val{0};
+  };
+
+  // callbacks
+  void on_sample(const sample &s) { sum += s.val; }
+
+  using me = sampler;
+  using transition_table = lsm::transition_table_type<
+      typename base::template transition<idle, start, running>,
+      typename base::template transition_cb<running, sample, running,
+                                            &me::on_sample>,
+      typename base::template transition<running, stop, idle>>;
+
+  using dispatch_policy = DispatchPolicy;
+  using error_policy = ErrorPolicy;
+  using instrumentation_policy = InstrumentationPolicy;
+
+  using sm_type = lsm::state_machine_front<sampler>;
+  sm_type state_machine;
+  std::uint64_t sum{0};
+
+  sampler() : state_machine{*this} {}
+};
+
+template <typename StoragePolicy>
+struct toggler : lsm::state_machine_desc<toggler<StoragePolicy>> {
+  using base = lsm::state_machine_desc<toggler<StoragePolicy>>;
+
+  // states owning a cache that is expensive to rebuild
+  struct heavy_state {
+    std::vector<std::uint32_t> cache = std::vector<std::uint32_t>(16384, 1);
+
+    void on_enter() { cache[0] += 1; }
+  };
+  struct on final : heavy_state {};
+  struct off final : heavy_state {};
+
+  // inputs
+  struct flip {};
+
+  using transition_table = lsm::transition_table_type<
+      typename base::template transition<on, flip, off>,
+      typename base::template transition<off, flip, on>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+  using storage_policy = StoragePolicy;
+
+  using sm_type = lsm::state_machine_front<toggler>;
+  sm_type state_machine;
+
+  toggler() : state_machine{*this} {}
+};
+
+// two concerns tracked by separate machines or by regions of one machine
+struct link_machine : lsm::state_machine_desc<link_machine> {
+  struct down {};
+  struct up {};
+
+  struct toggle {};
+
+  using transition_table =
+      lsm::transition_table_type<transition<down, toggle, up>,
+                                 transition<up, toggle, down>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+
+  using sm_type = lsm::state_machine_front<link_machine>;
+  sm_type state_machine;
+
+  link_machine() : state_machine{*this} {}
+};
+
+struct rate_machine : lsm::state_machine_desc<rate_machine> {
+  using toggle = link_machine::toggle;
+
+  struct normal {};
+  struct limited {};
+
+  using transition_table =
+      lsm::transition_table_type<transition<normal, toggle, limited>,
+                                 transition<limited, toggle, normal>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+
+  using sm_type = lsm::state_machine_front<rate_machine>;
+  sm_type state_machine;
+
+  rate_machine() : state_machine{*this} {}
+};
+
+struct link_rate_machine : lsm::state_machine_desc<link_rate_machine> {
+  using toggle = link_machine::toggle;
+
+  using regions = lsm::regions_type<
+      lsm::transition_table_type<
+          transition<link_machine::down, toggle, link_machine::up>,
+          transition<link_machine::up, toggle, link_machine::down>>,
+      lsm::transition_table_type<
+          transition<rate_machine::normal, toggle, rate_machine::limited>,
+          transition<rate_machine::limited, toggle, rate_machine::normal>>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+
+  using sm_type = lsm::region_machine_front<link_rate_machine>;
+  sm_type state_machine;
+
+  link_rate_machine() : state_machine{*this} {}
+};
+
+// machine reading through an asynchronous action
+struct reader : lsm::state_machine_desc<reader> {
+  using executor_type = lsm::thread_pool_executor;
+
+  struct idle {};
+  struct reading {};
+
+  struct read {
+    std::uint32_t val{0};
+  };
+  struct read_done {
+    std::uint32_t val{0};
+  };
+
+  void on_read(const read &r) {
+    async.await([val = r.val] { return read_done{val}; });
+  }
+
+  void on_read_done(const read_done &r) { sum += r.val; }
+
+  using me = reader;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<idle, read, reading, &me::on_read>,
+      transition_cb<reading, read_done, idle, &me::on_read_done>>;
+
+  using sm_type = lsm::state_machine_front<reader>;
+  sm_type state_machine;
+  lsm::async_machine<reader, executor_type> async;
+  std::uint64_t sum{0};
+
+  explicit reader(lsm::async_context<executor_type> &context)
+      : state_machine{*this}, async{state_machine, context} {
+    state_machine.init<idle>();
+  }
+};
+
+// actor forwarding a token to a pseudo random peer until its hops run out,
+// one forward out of 8 goes to one of the few hot peers
+struct relay : lsm::state_machine_desc<relay> {
+  static constexpr std::uint32_t hot_peers = 64;
+
+  struct active {};
+
+  struct token {
+    std::uint32_t hops{0};
+    std::uint32_t seed{0};
+  };
+
+  void on_token(const token &t);
+
+  using me = relay;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<active, token, active, &me::on_token>>;
+  using error_policy = lsm::policies::ignore_error;
+
+  lsm::state_machine_front<relay> state_machine;
+  lsm::actor<relay> actor;
+  std::vector<std::unique_ptr<relay>> &peers;
+  std::uint64_t handled{0};
+
+  relay(lsm::runtime &rt, std::vector<std::unique_ptr<relay>> &p)
+      : state_machine{*this}, actor{rt, state_machine}, peers{p} {
+    state_machine.init<active>();
+  }
+};
+
+void relay::on_token(const token &t) {
+  ++handled;
+  if (t.hops == 0) {
+    return;
+  }
+
+  std::uint32_t seed = t.seed * 1664525u + 1013904223u;
+  auto target = (seed >> 29) == 0 ? (seed >> 8) % hot_peers
+                                  : (seed >> 8) % peers.size();
+  peers[target]->actor.post(token{t.hops - 1, seed});
+}
+
+// machine fed with tagged binary records
+struct feed : lsm::state_machine_desc<feed> {
+  struct open {};
+  struct halted {};
+
+  struct quote {
+    static constexpr std::uint32_t wire_tag = 1;
+    std::uint32_t id{0};
+    std::uint32_t price{0};
+    std::uint64_t qty{0};
+  };
+  struct halt {
+    static constexpr std::uint32_t wire_tag = 2;
+  };
+  struct resume {
+    static constexpr std::uint32_t wire_tag = 3;
+  };
+
+  void on_quote(const quote &q) { volume += q.qty; }
+
+  using me = feed;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<open, quote, open, &me::on_quote>,
+      transition<open, halt, halted>, transition<halted, resume, open>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+  using error_policy = lsm::policies::ignore_error;
+
+  using sm_type = lsm::state_machine_front<feed>;
+  sm_type state_machine;
+  std::uint64_t volume{0};
+
+  feed() : state_machine{*this} { state_machine.init<open>(); }
+};
+
+// word and number tokenizer, run per byte or in lexer mode
+struct tokenizer : lsm::state_machine_desc<tokenizer> {
+  struct blank {};
+  struct word {};
+  struct number {};
+
+  struct space : lsm::byte_set<' ', '\t', '\n'> {};
+  struct alpha : lsm::byte_union<lsm::byte_range<'a', 'z'>,
+                                 lsm::byte_range<'A', 'Z'>,
+                                 lsm::byte_set<'_'>> {};
+  struct digit : lsm::byte_range<'0', '9'> {};
+
+  void on_word(const space &) { ++words; }
+  void on_number(const space &) { ++numbers; }
+
+  using me = tokenizer;
+  using transition_table = lsm::transition_table_type<
+      transition<blank, space, blank>, transition<blank, alpha, word>,
+      transition<blank, digit, number>, transition<word, alpha, word>,
+      transition<word, digit, word>,
+      transition_cb<word, space, blank, &me::on_word>,
+      transition<number, digit, number>,
+      transition_cb<number, space, blank, &me::on_number>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+
+  using sm_type = lsm::state_machine_front<tokenizer>;
+  sm_type state_machine;
+  lsm::lexer<tokenizer> lexer;
+  std::size_t words{0};
+  std::size_t numbers{0};
+
+  tokenizer() : state_machine{*this}, lexer{*this} {
+    state_machine.init<blank>();
+    lexer.init<blank>();
+  }
+};
+
+// account whose inputs may be journaled
+template <typename JournalPolicy>
+struct ledger : lsm::state_machine_desc<ledger<JournalPolicy>> {
+  using base = lsm::state_machine_desc<ledger<JournalPolicy>>;
+
+  struct active {};
+  struct frozen {};
+
+  struct deposit {
+    std::uint64_t amount{0};
+  };
+  struct freeze {};
+  struct thaw {};
+
+  void on_deposit(const deposit &d) { balance += d.amount; }
+
+  using me = ledger;
+  using transition_table = lsm::transition_table_type<
+      typename base::template transition_cb<active, deposit, active,
+                                            &me::on_deposit>,
+      typename base::template transition<active, freeze, frozen>,
+      typename base::template transition<frozen, thaw, active>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+  using journal_policy = JournalPolicy;
+
+  using sm_type = lsm::state_machine_front<ledger>;
+  sm_type state_machine;
+  std::uint64_t balance{0};
+
+  ledger() : state_machine{*this} { state_machine.template init<active>(); }
+};
+
+// greeting acknowledged from its own callback, the journal holds ack as
+// a nested input
+struct greeter : lsm::state_machine_desc<greeter> {
+  struct waiting {};
+  struct greeted {};
+  struct done {};
+
+  struct hello {};
+  struct ack {};
+  struct bye {};
+
+  void on_hello(const hello &) { state_machine.transit(ack{}); }
+
+  using me = greeter;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<waiting, hello, greeted, &me::on_hello>,
+      transition<greeted, ack, done>, transition<done, bye, waiting>>;
+
+  using event_policy = lsm::policies::queued_events<4>;
+  using journal_policy = lsm::policies::journaled;
+
+  using sm_type = lsm::state_machine_front<greeter>;
+  sm_type state_machine;
+
+  greeter() : state_machine{*this} { state_machine.init<waiting>(); }
+};
+
+// machine whose current state may be sampled by another thread
+template <typename ObserverPolicy>
+struct beacon : lsm::state_machine_desc<beacon<ObserverPolicy>> {
+  using base = lsm::state_machine_desc<beacon<ObserverPolicy>>;
+
+  struct healthy {};
+  struct degraded {};
+
+  struct flip {};
+
+  using transition_table = lsm::transition_table_type<
+      typename base::template transition<healthy, flip, degraded>,
+      typename base::template transition<degraded, flip, healthy>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+  using observer_policy = ObserverPolicy;
+
+  using sm_type = lsm::state_machine_front<beacon>;
+  sm_type state_machine;
+
+  beacon() : state_machine{*this} { state_machine.template init<healthy>(); }
+};
+
+// session waiting at most 30s for a reply
+struct session : lsm::state_machine_desc<session> {
+  struct idle {};
+
+  struct waiting {
+    static constexpr std::chrono::seconds timeout{30};
+  };
+
+  struct request {};
+  struct reply {};
+
+  void on_timeout(const lsm::timeout &) { ++expired; }
+
+  using me = session;
+  using transition_table = lsm::transition_table_type<
+      transition<idle, request, waiting>, transition<waiting, reply, idle>,
+      transition_cb<waiting, lsm::timeout, idle, &me::on_timeout>>;
+
+  using dispatch_policy = lsm::policies::table_dispatch;
+  using error_policy = lsm::policies::ignore_error;
+  using timer_policy = lsm::policies::state_timeouts<>;
+
+  using sm_type = lsm::state_machine_front<session>;
+  sm_type state_machine;
+  std::uint32_t expired{0};
+
+  session() : state_machine{*this} {}
+};
+
+// poll every 10ms: the timeout self transitions and runs again
+struct poller : lsm::state_machine_desc<poller> {
+  struct polling {
+    static constexpr std::chrono::milliseconds timeout{10};
+  };
+
+  void on_poll(const lsm::timeout &) { ++polls; }
+
+  using me = poller;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<polling, lsm::timeout, polling, &me::on_poll>>;
+
+  using timer_policy = lsm::policies::state_timeouts<>;
+
+  using sm_type = lsm::state_machine_front<poller>;
+  sm_type state_machine;
+  std::uint32_t polls{0};
+
+  poller() : state_machine{*this} {}
+};
+
+//--------------------------------------------------------
+// Helpers
+//--------------------------------------------------------
+
+template <typename F>
+double events_per_sec(std::size_t events, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return events / elapsed.count();
+}
+
+template <typename DispatchPolicy>
+void bench_batch(const std::string &name, std::size_t batch,
+                 std::size_t rounds) {
+  using machine = sampler<DispatchPolicy>;
+
+  std::vector<typename machine::sample> samples(batch);
+  for (std::size_t i = 0; i < batch; ++i) {
+    samples[i].val = static_cast<std::uint32_t>(i);
+  }
+
+  machine single;
+  single.state_machine.template init<typename machine::running>();
+  auto single_rate = events_per_sec(batch * rounds, [&] {
+    for (std::size_t r = 0; r < rounds; ++r) {
+      for (const auto &s : samples) {
+        single.state_machine.transit(s);
+      }
+    }
+  });
+
+  machine batched;
+  batched.state_machine.template init<typename machine::running>();
+  auto batch_rate = events_per_sec(batch * rounds, [&] {
+    for (std::size_t r = 0; r < rounds; ++r) {
+      batched.state_machine.transit_range(samples);
+    }
+  });
+
+  if (single.sum != batched.sum) {
+    std::cerr << "[-] " << name << ": result mismatch" << std::endl;
+  }
+
+  std::cout << name << " (batch " << batch << ")" << std::endl;
+  std::cout << "  transit loop  : " << single_rate << " events/s" << std::endl;
+  std::cout << "  transit_range : " << batch_rate << " events/s" << std::endl;
+}
+
+template <typename StoragePolicy>
+double bench_storage(std::size_t events) {
+  using machine = toggler<StoragePolicy>;
+
+  machine m;
+  m.state_machine.template init<typename machine::on>();
+
+  return events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      m.state_machine.transit(typename machine::flip{});
+    }
+  });
+}
+
+std::size_t rejected_count{0};
+
+void count_rejected(std::size_t, std::size_t) { ++rejected_count; }
+
+template <typename ErrorPolicy>
+double bench_rejected(std::size_t events) {
+  using machine = sampler<lsm::policies::table_dispatch, ErrorPolicy>;
+
+  machine m;
+  if constexpr (std::is_same_v<ErrorPolicy, lsm::policies::function_error>) {
+    m.state_machine.set_error_handler([](const std::string &) {
+      ++rejected_count;
+    });
+  }
+  m.state_machine.template init<typename machine::idle>();
+
+  return events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      m.state_machine.transit(typename machine::sample{});
+    }
+  });
+}
+
+void bench_queue(std::size_t producers, std::size_t events_per_producer) {
+  using machine = sampler<lsm::policies::table_dispatch>;
+  using queue_type =
+      lsm::queued_machine<machine, 4096, lsm::policies::block_when_full>;
+
+  machine m;
+  m.state_machine.init<machine::running>();
+  queue_type queue{m.state_machine};
+
+  auto rate = events_per_sec(producers * events_per_producer, [&] {
+    queue.start();
+
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&queue, events_per_producer] {
+        for (std::size_t i = 0; i < events_per_producer; ++i) {
+          queue.post(machine::sample{1});
+        }
+      });
+    }
+
+    for (auto &t : threads) {
+      t.join();
+    }
+
+    queue.stop();
+  });
+
+  if (m.sum != producers * events_per_producer) {
+    std::cerr << "[-] queued machine: lost events" << std::endl;
+  }
+
+  std::cout << "queued machine (" << producers << " producers)" << std::endl;
+  std::cout << "  post/drain    : " << rate << " events/s" << std::endl;
+}
+
+void bench_fleet(std::size_t machines, std::size_t events,
+                 std::size_t shards) {
+  using machine = sampler<lsm::policies::table_dispatch>;
+  using fleet_type = lsm::machine_fleet<machine>;
+  using event_type = std::pair<std::uint32_t, fleet_type::input_list_type>;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<std::uint32_t> ids(
+      0, static_cast<std::uint32_t>(machines - 1));
+  std::vector<event_type> batch(events);
+  for (std::size_t i = 0; i < events; ++i) {
+    batch[i].first = ids(gen);
+    if (i % 2) {
+      batch[i].second = machine::stop{};
+    } else {
+      batch[i].second = machine::start{};
+    }
+  }
+
+  machine desc;
+  fleet_type fleet{desc, machines, shards};
+  fleet.init<machine::idle>();
+
+  auto rate = events_per_sec(events, [&] { fleet.transit_batch(batch); });
+
+  std::cout << "machine fleet (" << machines << " machines, "
+            << fleet.shard_count() << " shards)" << std::endl;
+  std::cout << "  bytes/machine : " << sizeof(fleet_type::state_index_type)
+            << std::endl;
+  std::cout << "  transit_batch : " << rate << " events/s ("
+            << fleet.rejected() << " rejected)" << std::endl;
+}
+
+void bench_regions(std::size_t events) {
+  using toggle = link_machine::toggle;
+
+  link_machine link;
+  rate_machine rate;
+  link.state_machine.init<link_machine::down>();
+  rate.state_machine.init<rate_machine::normal>();
+  auto separate_rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      link.state_machine.transit(toggle{});
+      rate.state_machine.transit(toggle{});
+    }
+  });
+
+  link_rate_machine regions;
+  regions.state_machine.init<link_machine::down, rate_machine::normal>();
+  auto regions_rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      regions.state_machine.transit(toggle{});
+    }
+  });
+
+  std::cout << "orthogonal regions (2 regions)" << std::endl;
+  std::cout << "  separate machines : " << separate_rate << " events/s"
+            << std::endl;
+  std::cout << "  region machine    : " << regions_rate << " events/s"
+            << std::endl;
+}
+
+void bench_snapshot(std::size_t machines) {
+  using machine = sampler<lsm::policies::table_dispatch>;
+  using fleet_type = lsm::machine_fleet<machine>;
+  using format_type = lsm::snapshot_format<machine>;
+
+  machine desc;
+  fleet_type fleet{desc, machines, 1};
+  fleet.init<machine::idle>();
+  for (std::size_t id = 0; id < machines; id += 2) {
+    fleet.transit(id, machine::start{});
+  }
+
+  std::vector<std::byte> buffer(format_type::size(machines));
+  auto save_rate = events_per_sec(machines, [&] {
+    lsm::snapshot_writer<machine>{buffer.data(), machines}.save_fleet(fleet);
+  });
+
+  fleet_type restored{desc, machines, 1};
+  bool valid = false;
+  auto restore_rate = events_per_sec(machines, [&] {
+    valid = lsm::snapshot_reader<machine>{buffer.data(), buffer.size()}
+                .restore_fleet(restored);
+  });
+
+  if (!valid || !restored.is<machine::running>(0) ||
+      !restored.is<machine::idle>(1)) {
+    std::cerr << "[-] snapshot: restore mismatch" << std::endl;
+  }
+
+  std::cout << "snapshot (" << machines << " machines, " << buffer.size()
+            << " bytes)" << std::endl;
+  std::cout << "  save    : " << save_rate << " machines/s" << std::endl;
+  std::cout << "  restore : " << restore_rate << " machines/s" << std::endl;
+}
+
+void bench_async(std::size_t machines, std::size_t reads,
+                 std::size_t threads) {
+  lsm::thread_pool_executor pool{threads};
+  lsm::async_context<lsm::thread_pool_executor> context{pool};
+
+  std::vector<std::unique_ptr<reader>> readers;
+  for (std::size_t i = 0; i < machines; ++i) {
+    readers.push_back(std::make_unique<reader>(context));
+  }
+
+  // reads beyond the first one are queued while an action is pending
+  auto rate = events_per_sec(machines * reads, [&] {
+    for (auto &r : readers) {
+      for (std::size_t i = 0; i < reads; ++i) {
+        r->async.transit(reader::read{1});
+      }
+    }
+    context.run();
+  });
+
+  std::uint64_t sum = 0;
+  for (const auto &r : readers) {
+    sum += r->sum;
+  }
+  if (sum != machines * reads) {
+    std::cerr << "[-] async machine: lost reads" << std::endl;
+  }
+
+  std::cout << "async actions (" << machines << " machines, " << threads
+            << " executor threads)" << std::endl;
+  std::cout << "  await/complete : " << rate << " actions/s" << std::endl;
+}
+
+template <typename InstrumentationPolicy>
+double bench_instrumentation(std::size_t events) {
+  using machine = sampler<lsm::policies::table_dispatch,
+                          lsm::policies::function_error, InstrumentationPolicy>;
+
+  machine m;
+  m.state_machine.template init<typename machine::idle>();
+
+  auto rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      m.state_machine.transit(typename machine::start{});
+      m.state_machine.transit(typename machine::sample{1});
+      m.state_machine.transit(typename machine::stop{});
+    }
+  });
+
+  if constexpr (std::is_same_v<InstrumentationPolicy,
+                               lsm::policies::transition_stats>) {
+    for (const auto &tx : m.state_machine.recorder().snapshot().transitions) {
+      std::cout << "    " << tx.state << " x " << tx.input << ": " << tx.hits
+                << " hits" << std::endl;
+    }
+  } else if constexpr (std::is_same_v<InstrumentationPolicy,
+                                      lsm::policies::hook_stats>) {
+    for (const auto &st : m.state_machine.recorder().snapshot().states) {
+      std::cout << "    " << st.state << ": " << st.enter.count()
+                << " enters, " << st.exit.count() << " exits" << std::endl;
+    }
+  }
+
+  return rate;
+}
+
+//--------------------------------------------------------
+// Main
+//--------------------------------------------------------
+
+void bench_runtime(std::size_t actors, std::size_t tokens, std::uint32_t hops,
+                   std::size_t threads) {
+  lsm::runtime rt{threads};
+
+  std::vector<std::unique_ptr<relay>> relays;
+  relays.reserve(actors);
+  for (std::size_t i = 0; i < actors; ++i) {
+    relays.push_back(std::make_unique<relay>(rt, relays));
+  }
+
+  // tokens start on the first actors only, stealing spreads the load
+  auto rate = events_per_sec(tokens * (hops + 1), [&] {
+    for (std::size_t i = 0; i < tokens; ++i) {
+      relays[i % 1000]->actor.post(
+          relay::token{hops, static_cast<std::uint32_t>(i)});
+    }
+    rt.wait();
+  });
+
+  std::uint64_t handled = 0;
+  for (const auto &r : relays) {
+    handled += r->handled;
+  }
+  if (handled != tokens * (hops + 1)) {
+    std::cerr << "[-] actor runtime: lost tokens" << std::endl;
+  }
+
+  std::cout << "actor runtime (" << actors << " actors, " << threads
+            << " workers)" << std::endl;
+  std::cout << "  relay : " << rate << " inputs/s" << std::endl;
+}
+
+void bench_lexer(std::size_t bytes) {
+  // words, numbers and runs of blanks of random lengths
+  std::mt19937 gen{42};
+  std::string text;
+  while (text.size() < bytes) {
+    auto len = 1 + gen() % 24;
+    auto kind = gen() % 3;
+    for (std::size_t i = 0; i < len; ++i) {
+      text += kind == 0 ? static_cast<char>('a' + gen() % 26)
+                        : kind == 1 ? static_cast<char>('0' + gen() % 10) : ' ';
+    }
+    text += ' ';
+  }
+
+  tokenizer per_byte;
+  auto transit_rate = events_per_sec(text.size(), [&] {
+    for (unsigned char c : text) {
+      if (tokenizer::space::contains(c)) {
+        per_byte.state_machine.transit(tokenizer::space{});
+      } else if (tokenizer::alpha::contains(c)) {
+        per_byte.state_machine.transit(tokenizer::alpha{});
+      } else {
+        per_byte.state_machine.transit(tokenizer::digit{});
+      }
+    }
+  });
+
+  tokenizer lexed;
+  std::size_t consumed = 0;
+  auto lexer_rate =
+      events_per_sec(text.size(), [&] { consumed = lexed.lexer.run(text); });
+
+  if (consumed != text.size() || lexed.words != per_byte.words ||
+      lexed.numbers != per_byte.numbers) {
+    std::cerr << "[-] lexer: token mismatch" << std::endl;
+  }
+
+  std::cout << "tokenizer (" << lexed.words + lexed.numbers << " tokens)"
+            << std::endl;
+  std::cout << "  per byte transit : " << transit_rate / 1e6 << " MB/s"
+            << std::endl;
+  std::cout << "  lexer            : " << lexer_rate / 1e6 << " MB/s"
+            << std::endl;
+}
+
+template <typename Machine>
+void feed_ledger(Machine &m, std::size_t records) {
+  for (std::size_t i = 0; i < records; ++i) {
+    if (i % 1000 == 999) {
+      m.state_machine.transit(typename Machine::freeze{});
+      m.state_machine.transit(typename Machine::thaw{});
+    } else {
+      m.state_machine.transit(typename Machine::deposit{i});
+    }
+  }
+}
+
+void bench_journal(std::size_t records) {
+  using plain = ledger<lsm::policies::no_journal>;
+  using journaled = ledger<lsm::policies::journaled>;
+
+  auto dir = std::filesystem::temp_directory_path() / "lsm_bench_journal";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  auto path = (dir / "ledger").string();
+  auto count = records + records / 1000;
+
+  plain raw;
+  auto raw_rate = events_per_sec(count, [&] { feed_ledger(raw, records); });
+
+  journaled recorded;
+  double record_rate = 0;
+  {
+    lsm::journal_log<journaled> log{path};
+    recorded.state_machine.journal().attach(&log);
+    record_rate = events_per_sec(count, [&] {
+      feed_ledger(recorded, records);
+      log.flush();
+    });
+    recorded.state_machine.journal().attach(nullptr);
+  }
+
+  lsm::journal_reader<journaled> reader{path};
+  journaled replayed;
+  std::size_t replayed_count = 0;
+  auto replay_rate = events_per_sec(count, [&] {
+    replayed_count = reader.replay(replayed.state_machine, true);
+  });
+
+  journaled rebuilt;
+  auto rebuild_rate = events_per_sec(
+      count, [&] { reader.replay(rebuilt.state_machine, false); });
+
+  if (replayed_count != count || replayed.balance != raw.balance ||
+      rebuilt.state_machine.index() != raw.state_machine.index()) {
+    std::cerr << "[-] journal: replay mismatch" << std::endl;
+  }
+
+  // inputs applied from callbacks are replayed from the journal only when
+  // callbacks are not called
+  auto greetings = (dir / "greeter").string();
+  greeter greeted;
+  {
+    lsm::journal_log<greeter> log{greetings};
+    greeted.state_machine.journal().attach(&log);
+    greeted.state_machine.transit(greeter::hello{});
+    greeted.state_machine.transit(greeter::bye{});
+    greeted.state_machine.transit(greeter::hello{});
+    greeted.state_machine.journal().attach(nullptr);
+  }
+
+  lsm::journal_reader<greeter> greetings_reader{greetings};
+  greeter with_callbacks;
+  greeter without_callbacks;
+  greetings_reader.replay(with_callbacks.state_machine, true);
+  greetings_reader.replay(without_callbacks.state_machine, false);
+  if (!greeted.state_machine.is<greeter::done>() ||
+      with_callbacks.state_machine.index() != greeted.state_machine.index() ||
+      without_callbacks.state_machine.index() !=
+          greeted.state_machine.index()) {
+    std::cerr << "[-] journal: nested input replay mismatch" << std::endl;
+  }
+  std::filesystem::remove_all(dir);
+
+  std::cout << "input journal" << std::endl;
+  std::cout << "  transit                   : " << raw_rate << " events/s"
+            << std::endl;
+  std::cout << "  journaled transit         : " << record_rate << " events/s"
+            << std::endl;
+  std::cout << "  replay with callbacks     : " << replay_rate << " events/s"
+            << std::endl;
+  std::cout << "  replay without callbacks  : " << rebuild_rate
+            << " events/s" << std::endl;
+}
+
+template <typename ObserverPolicy>
+double flip_all(std::vector<std::unique_ptr<beacon<ObserverPolicy>>> &machines,
+                std::size_t rounds) {
+  return events_per_sec(machines.size() * rounds, [&] {
+    for (std::size_t r = 0; r < rounds; ++r) {
+      for (auto &m : machines) {
+        m->state_machine.transit(typename beacon<ObserverPolicy>::flip{});
+      }
+    }
+  });
+}
+
+void bench_observer(std::size_t count, std::size_t rounds) {
+  using hidden = beacon<lsm::policies::unobserved_state>;
+  using observed = beacon<lsm::policies::observable_state>;
+
+  std::vector<std::unique_ptr<hidden>> plain;
+  std::vector<std::unique_ptr<observed>> machines;
+  std::vector<lsm::state_observer<observed>> observers;
+  for (std::size_t i = 0; i < count; ++i) {
+    plain.push_back(std::make_unique<hidden>());
+    machines.push_back(std::make_unique<observed>());
+    observers.emplace_back(machines.back()->state_machine);
+  }
+
+  auto published_rate = flip_all(machines, rounds);
+  auto plain_rate = flip_all(plain, rounds);
+
+  // a monitoring thread samples every machine while they are flipped
+  std::atomic<bool> done{false};
+  std::size_t samples = 0;
+  std::size_t degraded = 0;
+  double sample_rate = 0;
+  std::thread monitor([&] {
+    auto start = std::chrono::steady_clock::now();
+    while (!done.load(std::memory_order_relaxed)) {
+      for (const auto &o : observers) {
+        degraded += o.is<observed::degraded>();
+      }
+      samples += observers.size();
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    sample_rate = samples / elapsed.count();
+  });
+
+  auto observed_rate = flip_all(machines, rounds);
+  done.store(true);
+  monitor.join();
+
+  if (degraded > samples) {
+    std::cerr << "[-] observer: bad sample count" << std::endl;
+  }
+
+  std::cout << "observable state (" << count << " machines)" << std::endl;
+  std::cout << "  transit, unobserved       : " << plain_rate << " events/s"
+            << std::endl;
+  std::cout << "  transit, published        : " << published_rate
+            << " events/s" << std::endl;
+  std::cout << "  transit, sampled          : " << observed_rate
+            << " events/s" << std::endl;
+  std::cout << "  monitor samples           : " << sample_rate
+            << " samples/s" << std::endl;
+}
+
+void bench_timers(std::size_t count, std::uint64_t spread) {
+  constexpr std::uint64_t timeout = 30000;
+  auto per_tick = std::max<std::size_t>(count / spread, 1);
+
+  // requests are spread over the first ticks, one out of two is replied
+  // before its timeout
+  lsm::timer_wheel wheel;
+  auto machines = std::make_unique<session[]>(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    machines[i].state_machine.timers().attach(&wheel);
+    machines[i].state_machine.init<session::idle>();
+  }
+
+  auto arm_rate = events_per_sec(count, [&] {
+    for (std::size_t i = 0; i < count; ++i) {
+      machines[i].state_machine.transit(session::request{});
+      if (i % per_tick == per_tick - 1) {
+        wheel.advance();
+      }
+    }
+  });
+  auto armed = wheel.size();
+
+  auto cancel_rate = events_per_sec(count / 2, [&] {
+    for (std::size_t i = 0; i < count; i += 2) {
+      machines[i].state_machine.transit(session::reply{});
+    }
+  });
+
+  std::size_t fired = 0;
+  auto ticks = timeout + spread;
+  auto tick_rate =
+      events_per_sec(ticks, [&] { fired = wheel.advance(ticks); });
+
+  std::size_t expired = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    expired += machines[i].expired;
+  }
+  if (fired != count - count / 2 || expired != fired || wheel.size() != 0) {
+    std::cerr << "[-] timers: " << fired << " timeouts fired" << std::endl;
+  }
+  machines.reset();
+
+  // periodic timeout, armed again after each self transition
+  poller periodic;
+  periodic.state_machine.timers().attach(&wheel);
+  periodic.state_machine.init<poller::polling>();
+  wheel.advance(100);
+  if (periodic.polls != 10 || !periodic.state_machine.timers().armed()) {
+    std::cerr << "[-] timers: " << periodic.polls << " polls" << std::endl;
+  }
+
+  // same timeouts kept in a priority queue, replies cancel lazily
+  using entry = std::pair<std::uint64_t, std::uint32_t>;
+  std::priority_queue<entry, std::vector<entry>, std::greater<entry>> queue;
+  std::vector<std::uint8_t> replied(count);
+  std::size_t queue_fired = 0;
+  auto queue_rate = events_per_sec(count, [&] {
+    std::uint64_t now = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      queue.push({now + timeout, static_cast<std::uint32_t>(i)});
+      if (i % per_tick == per_tick - 1) {
+        ++now;
+      }
+    }
+    for (std::size_t i = 0; i < count; i += 2) {
+      replied[i] = 1;
+    }
+    for (auto end = now + ticks; now != end; ++now) {
+      while (!queue.empty() && queue.top().first <= now) {
+        queue_fired += replied[queue.top().second] == 0;
+        queue.pop();
+      }
+    }
+  });
+
+  std::cout << "state timeouts (" << armed << " armed)" << std::endl;
+  std::cout << "  arm on enter              : " << arm_rate << " events/s"
+            << std::endl;
+  std::cout << "  cancel on exit            : " << cancel_rate
+            << " events/s" << std::endl;
+  std::cout << "  wheel ticks               : " << tick_rate << " ticks/s, "
+            << fired * tick_rate / ticks << " timeouts/s" << std::endl;
+  std::cout << "  priority queue            : " << queue_rate
+            << " timers/s, " << queue_fired << " timeouts" << std::endl;
+}
+
+void bench_dynamic(std::size_t records) {
+  // same machine as ledger, loaded at runtime
+  auto def = lsm::machine_definition::parse(R"(
+    transition active deposit active on_deposit
+    transition active freeze frozen
+    transition frozen thaw active
+  )");
+  const auto deposit = def.input_id("deposit");
+  const auto freeze = def.input_id("freeze");
+  const auto thaw = def.input_id("thaw");
+  auto count = records + records / 1000;
+
+  ledger<lsm::policies::no_journal> compiled;
+  auto compiled_rate =
+      events_per_sec(count, [&] { feed_ledger(compiled, records); });
+
+  lsm::dynamic_machine<std::uint64_t> loaded{def};
+  std::uint64_t balance = 0;
+  loaded.bind("on_deposit", [&balance](std::uint32_t, const std::uint64_t &a) {
+    balance += a;
+  });
+  loaded.init();
+
+  auto loaded_rate = events_per_sec(count, [&] {
+    for (std::size_t i = 0; i < records; ++i) {
+      if (i % 1000 == 999) {
+        loaded.transit(freeze);
+        loaded.transit(thaw);
+      } else {
+        loaded.transit(deposit, i);
+      }
+    }
+  });
+
+  if (balance != compiled.balance) {
+    std::cerr << "[-] dynamic: balances differ" << std::endl;
+  }
+
+  std::cout << "runtime loaded machine" << std::endl;
+  std::cout << "  compile time table        : " << compiled_rate
+            << " events/s" << std::endl;
+  std::cout << "  runtime table             : " << loaded_rate << " events/s"
+            << std::endl;
+}
+
+void bench_wire(std::size_t records) {
+  using decoder_type = lsm::wire_decoder<feed, 8>;
+
+  // quotes with a halt/resume pair every 1000 records
+  std::vector<std::uint64_t> storage(records * 3);
+  auto buffer = reinterpret_cast<std::byte *>(storage.data());
+  std::size_t size = 0;
+
+  auto put = [&](std::uint32_t tag, const void *payload, std::uint32_t len) {
+    lsm::wire_record_header header{tag, len};
+    std::memcpy(buffer + size, &header, sizeof(header));
+    std::memcpy(buffer + size + sizeof(header), payload, len);
+    size += decoder_type::record_size(len);
+  };
+
+  for (std::size_t i = 0; i < records; ++i) {
+    if (i % 1000 == 999) {
+      put(feed::halt::wire_tag, nullptr, 0);
+      put(feed::resume::wire_tag, nullptr, 0);
+    } else {
+      feed::quote q{static_cast<std::uint32_t>(i), 100, i % 7};
+      put(feed::quote::wire_tag, &q, sizeof(q));
+    }
+  }
+  auto count = records + records / 1000;
+
+  // decode into a struct, then transit
+  feed copied;
+  auto copy_rate = events_per_sec(count, [&] {
+    for (std::size_t offset = 0; offset < size;) {
+      lsm::wire_record_header header;
+      std::memcpy(&header, buffer + offset, sizeof(header));
+      auto payload = buffer + offset + sizeof(header);
+
+      switch (header.tag) {
+        case feed::quote::wire_tag: {
+          feed::quote q;
+          std::memcpy(&q, payload, sizeof(q));
+          copied.state_machine.transit(q);
+          break;
+        }
+        case feed::halt::wire_tag:
+          copied.state_machine.transit(feed::halt{});
+          break;
+        case feed::resume::wire_tag:
+          copied.state_machine.transit(feed::resume{});
+          break;
+      }
+      offset += decoder_type::record_size(header.size);
+    }
+  });
+
+  feed decoded;
+  decoder_type decoder{decoded.state_machine};
+  auto wire_rate = events_per_sec(
+      count, [&] { decoder.transit_buffer(buffer, size); });
+
+  if (copied.volume != decoded.volume || decoder.malformed() != 0) {
+    std::cerr << "[-] wire decoder: volume mismatch" << std::endl;
+  }
+
+  std::cout << "tagged binary records" << std::endl;
+  std::cout << "  copy and transit : " << copy_rate << " records/s"
+            << std::endl;
+  std::cout << "  wire decoder     : " << wire_rate << " records/s"
+            << std::endl;
+}
+
+int main() {
+  constexpr std::size_t batch = 256;
+  constexpr std::size_t rounds = 200000;
+
+  bench_batch<lsm::policies::visit_dispatch>("visit dispatch", batch, rounds);
+  bench_batch<lsm::policies::table_dispatch>("table dispatch", batch, rounds);
+
+  std::cout << "heavy state transitions" << std::endl;
+  std::cout << "  variant storage    : "
+            << bench_storage<lsm::policies::variant_storage>(100000)
+            << " events/s" << std::endl;
+  std::cout << "  persistent storage : "
+            << bench_storage<lsm::policies::persistent_storage>(100000)
+            << " events/s" << std::endl;
+
+  constexpr std::size_t rejected = 10000000;
+  std::cout << "rejected transitions" << std::endl;
+  std::cout << "  function_error : "
+            << bench_rejected<lsm::policies::function_error>(rejected)
+            << " events/s" << std::endl;
+  std::cout << "  static_error   : "
+            << bench_rejected<lsm::policies::static_error<&count_rejected>>(
+                   rejected)
+            << " events/s" << std::endl;
+  std::cout << "  ignore_error   : "
+            << bench_rejected<lsm::policies::ignore_error>(rejected)
+            << " events/s" << std::endl;
+
+  bench_regions(10000000);
+
+  bench_wire(10000000);
+
+  bench_lexer(64 << 20);
+
+  constexpr std::size_t instrumented = 1000000;
+  std::cout << "instrumentation (3 transitions per round)" << std::endl;
+  std::cout << "  no_instrumentation : "
+            << bench_instrumentation<lsm::policies::no_instrumentation>(
+                   instrumented)
+            << " rounds/s" << std::endl;
+  auto stats_rate =
+      bench_instrumentation<lsm::policies::transition_stats>(instrumented);
+  std::cout << "  transition_stats   : " << stats_rate << " rounds/s"
+            << std::endl;
+  auto hook_rate =
+      bench_instrumentation<lsm::policies::hook_stats>(instrumented);
+  std::cout << "  hook_stats         : " << hook_rate << " rounds/s"
+            << std::endl;
+
+  for (std::size_t producers : {1, 2, 4}) {
+    bench_queue(producers, 1000000);
+  }
+
+  for (std::size_t shards : {1, 2, 4}) {
+    bench_fleet(1000000, 4000000, shards);
+  }
+
+  bench_snapshot(1000000);
+
+  bench_journal(10000000);
+
+  bench_observer(1000000, 20);
+
+  bench_timers(10000000, 1000);
+
+  bench_dynamic(10000000);
+
+  bench_async(10000, 10, 4);
+
+  for (std::size_t threads : {1, 4}) {
+    bench_runtime(1000000, 200000, 10, threads);
+  }
+
+  return 0;
+}
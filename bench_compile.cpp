@@ -0,0 +1,52 @@
+#include "lsm.h"
+
+#include <cstddef>
+#include <utility>
+
+//--------------------------------------------------------
+// Generated machine used to measure lsm compile time
+//--------------------------------------------------------
+
+// number of transitions, build with -DLSM_BENCH_TRANSITIONS=<n>
+#ifndef LSM_BENCH_TRANSITIONS
+#define LSM_BENCH_TRANSITIONS 100
+#endif
+
+constexpr std::size_t transitions = LSM_BENCH_TRANSITIONS;
+constexpr std::size_t inputs = 10;
+constexpr std::size_t states = (transitions + inputs - 1) / inputs;
+
+template <std::size_t I>
+struct state {};
+
+template <std::size_t I>
+struct input {};
+
+struct generated : lsm::state_machine_desc<generated> {
+  // transition i goes from state i % states to the next state on input
+  // i / states, so each (state, input) pair appears once
+  template <std::size_t... Is>
+  static auto make_table(std::index_sequence<Is...>)
+      -> lsm::transition_table_type<
+          transition<state<Is % states>, input<Is / states>,
+                     state<(Is + 1) % states>>...>;
+
+  using transition_table =
+      decltype(make_table(std::make_index_sequence<transitions>{}));
+
+  using error_policy = lsm::policies::ignore_error;
+  using dispatch_policy = lsm::policies::table_dispatch;
+
+  using sm_type = lsm::state_machine_front<generated>;
+  sm_type state_machine;
+
+  generated() : state_machine{*this} {}
+};
+
+int main() {
+  generated g;
+  g.state_machine.init<state<0>>();
+  g.state_machine.transit(input<0>{});
+  g.state_machine.transit(input<inputs - 1>{});
+  return 0;
+}
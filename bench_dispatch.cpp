@@ -0,0 +1,263 @@
+#include "lsm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+//--------------------------------------------------------
+// Dispatch microbenchmarks, results are printed as JSON:
+//   { "compiler": ..., "results": [ { "machine": ..., "states": ...,
+//     "inputs": ..., "case": ..., "ns_per_event": ... }, ... ] }
+//--------------------------------------------------------
+
+// keep the machine in memory across iterations
+template <typename T>
+void escape(T &value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(&value) : "memory");
+#else
+  static T *volatile sink;
+  sink = &value;
+#endif
+}
+
+template <std::size_t I>
+struct state {};
+
+template <std::size_t I>
+struct input {};
+
+// input 0 is a self transition, input i > 0 moves from state s to state
+// (s + i) % States, the last input is only accepted in state 0
+template <std::size_t States, std::size_t Inputs, typename DispatchPolicy,
+          typename ErrorPolicy = lsm::policies::ignore_error>
+struct generated : lsm::state_machine_desc<
+                       generated<States, Inputs, DispatchPolicy, ErrorPolicy>> {
+  using base = lsm::state_machine_desc<generated>;
+
+  template <std::size_t S, std::size_t... Is>
+  static auto row(std::index_sequence<Is...>)
+      -> lsm::list::mplist<typename base::template transition<
+          state<S>, input<Is>, state<(S + Is) % States>>...>;
+
+  template <std::size_t... Ss>
+  static auto make_table(std::index_sequence<Ss...>)
+      -> lsm::list::push_front_t<
+          typename base::template transition<state<0>, input<Inputs - 1>,
+                                             state<0>>,
+          lsm::list::concat_all_t<decltype(
+              row<Ss>(std::make_index_sequence<Inputs - 1>{}))...>>;
+
+  using transition_table =
+      decltype(make_table(std::make_index_sequence<States>{}));
+
+  using dispatch_policy = DispatchPolicy;
+  using error_policy = ErrorPolicy;
+
+  using sm_type = lsm::state_machine_front<generated>;
+  sm_type state_machine;
+
+  generated() : state_machine{*this} {
+    state_machine.template init<state<0>>();
+  }
+};
+
+// hand-written equivalent of generated<4, 4, ...>
+struct switch_machine {
+  enum state_id : std::uint8_t { s0, s1, s2, s3 };
+  enum input_id : std::uint8_t { i0, i1, i2, i3 };
+
+  state_id state{s0};
+  std::size_t rejected{0};
+
+  void transit(input_id input) {
+    switch (state) {
+      case s0:
+        switch (input) {
+          case i0: break;
+          case i1: state = s1; break;
+          case i2: state = s2; break;
+          case i3: break;
+        }
+        break;
+      case s1:
+        switch (input) {
+          case i0: break;
+          case i1: state = s2; break;
+          case i2: state = s3; break;
+          default: ++rejected; break;
+        }
+        break;
+      case s2:
+        switch (input) {
+          case i0: break;
+          case i1: state = s3; break;
+          case i2: state = s0; break;
+          default: ++rejected; break;
+        }
+        break;
+      case s3:
+        switch (input) {
+          case i0: break;
+          case i1: state = s0; break;
+          case i2: state = s1; break;
+          default: ++rejected; break;
+        }
+        break;
+    }
+  }
+};
+
+//--------------------------------------------------------
+// Helpers
+//--------------------------------------------------------
+
+constexpr std::size_t events = 10000000;
+constexpr std::size_t repeats = 5;
+
+// best of a few runs of events calls
+template <typename F>
+double ns_per_event(F &&f) {
+  double best = 0;
+  for (std::size_t r = 0; r < repeats; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < events; ++i) {
+      f();
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    auto ns = elapsed.count() / events;
+    best = r == 0 ? ns : std::min(best, ns);
+  }
+  return best;
+}
+
+class json_results {
+ public:
+  json_results() {
+    std::cout << "{\n  \"compiler\": \"" << compiler() << "\",\n"
+              << "  \"events\": " << events << ",\n  \"results\": [";
+  }
+
+  ~json_results() { std::cout << "\n  ]\n}" << std::endl; }
+
+  void add(const std::string &machine, std::size_t states,
+           std::size_t inputs, const std::string &kind, double ns) {
+    std::cout << (m_first ? "\n" : ",\n") << "    {\"machine\": \"" << machine
+              << "\", \"states\": " << states << ", \"inputs\": " << inputs
+              << ", \"case\": \"" << kind << "\", \"ns_per_event\": " << ns
+              << "}";
+    m_first = false;
+  }
+
+ private:
+  static std::string compiler() {
+#if defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string(_MSC_VER);
+#else
+    return "unknown";
+#endif
+  }
+
+  bool m_first{true};
+};
+
+//--------------------------------------------------------
+// Benchmarks
+//--------------------------------------------------------
+
+template <std::size_t States, std::size_t Inputs, typename DispatchPolicy>
+void bench_generated(json_results &out, const std::string &name) {
+  using machine = generated<States, Inputs, DispatchPolicy>;
+
+  machine self;
+  out.add(name, States, Inputs, "self", ns_per_event([&] {
+            self.state_machine.transit(input<0>{});
+            escape(self);
+          }));
+
+  machine change;
+  out.add(name, States, Inputs, "change", ns_per_event([&] {
+            change.state_machine.transit(input<1>{});
+            escape(change);
+          }));
+
+  // rejected in every state but state 0
+  machine rejected;
+  rejected.state_machine.transit(input<1>{});
+  out.add(name, States, Inputs, "rejected", ns_per_event([&] {
+            rejected.state_machine.transit(input<Inputs - 1>{});
+            escape(rejected);
+          }));
+}
+
+template <typename ErrorPolicy>
+void bench_rejected(json_results &out, const std::string &name) {
+  using machine =
+      generated<16, 8, lsm::policies::table_dispatch, ErrorPolicy>;
+
+  machine m;
+  if constexpr (std::is_same_v<ErrorPolicy, lsm::policies::function_error>) {
+    m.state_machine.set_error_handler([](const std::string &) {});
+  }
+  m.state_machine.transit(input<1>{});
+
+  out.add(name, 16, 8, "rejected", ns_per_event([&] {
+            m.state_machine.transit(input<7>{});
+            escape(m);
+          }));
+}
+
+void count_rejected(std::size_t, std::size_t) {}
+
+void bench_switch(json_results &out) {
+  switch_machine self;
+  out.add("switch", 4, 4, "self", ns_per_event([&] {
+            self.transit(switch_machine::i0);
+            escape(self);
+          }));
+
+  switch_machine change;
+  out.add("switch", 4, 4, "change", ns_per_event([&] {
+            change.transit(switch_machine::i1);
+            escape(change);
+          }));
+
+  switch_machine rejected;
+  rejected.transit(switch_machine::i1);
+  out.add("switch", 4, 4, "rejected", ns_per_event([&] {
+            rejected.transit(switch_machine::i3);
+            escape(rejected);
+          }));
+}
+
+int main() {
+  json_results out;
+
+  bench_switch(out);
+
+  bench_generated<4, 4, lsm::policies::visit_dispatch>(out, "visit_dispatch");
+  bench_generated<4, 4, lsm::policies::table_dispatch>(out, "table_dispatch");
+  bench_generated<16, 8, lsm::policies::visit_dispatch>(out, "visit_dispatch");
+  bench_generated<16, 8, lsm::policies::table_dispatch>(out, "table_dispatch");
+  bench_generated<32, 16, lsm::policies::visit_dispatch>(out,
+                                                         "visit_dispatch");
+  bench_generated<32, 16, lsm::policies::table_dispatch>(out,
+                                                         "table_dispatch");
+
+  bench_rejected<lsm::policies::function_error>(out, "function_error");
+  bench_rejected<lsm::policies::static_error<&count_rejected>>(
+      out, "static_error");
+  bench_rejected<lsm::policies::ignore_error>(out, "ignore_error");
+
+  return 0;
+}
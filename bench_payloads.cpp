@@ -0,0 +1,262 @@
+#include "lsm.h"
+#include "lsm_arena.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//--------------------------------------------------------
+// Payload benchmark, heap allocations per input are counted by replacing
+// the global allocation functions of this program only
+//--------------------------------------------------------
+
+// heap allocations of the calling thread
+thread_local std::size_t heap_allocations = 0;
+
+namespace {
+void *counted_alloc(std::size_t size, std::size_t align) {
+  ++heap_allocations;
+  size = size != 0 ? size : 1;
+  if (align <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  // aligned_alloc requires a multiple of the alignment
+  return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+void *checked_alloc(std::size_t size, std::size_t align) {
+  if (auto p = counted_alloc(size, align)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+constexpr auto default_align = alignof(std::max_align_t);
+}  // namespace
+
+void *operator new(std::size_t size) {
+  return checked_alloc(size, default_align);
+}
+
+void *operator new[](std::size_t size) {
+  return checked_alloc(size, default_align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align) {
+  return checked_alloc(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return checked_alloc(size, static_cast<std::size_t>(align));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size, default_align);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size, default_align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+//--------------------------------------------------------
+// Benchmark machine
+//--------------------------------------------------------
+
+// sink of payload heavy inputs, allocated from the heap or from an arena
+template <typename ArenaPolicy>
+struct collector : lsm::state_machine_desc<collector<ArenaPolicy>> {
+  using base = lsm::state_machine_desc<collector<ArenaPolicy>>;
+
+  struct record {
+    std::uint64_t key{0};
+    std::uint64_t value{0};
+  };
+
+  using allocator_type =
+      std::conditional_t<std::is_same_v<ArenaPolicy, lsm::policies::no_arena>,
+                         std::allocator<record>,
+                         lsm::arena_allocator<record>>;
+  using records_type = std::vector<record, allocator_type>;
+
+  struct collecting {};
+
+  struct batch {
+    records_type records;
+  };
+
+  // taken by value: moved from an rvalue input, copied from an lvalue one
+  void on_batch(batch b) {
+    for (const auto &r : b.records) {
+      sum += r.value;
+    }
+  }
+
+  using me = collector;
+  using transition_table =
+      lsm::transition_table_type<typename base::template transition_cb<
+          collecting, batch, collecting, &me::on_batch>>;
+
+  using arena_policy = ArenaPolicy;
+
+  using sm_type = lsm::state_machine_front<collector>;
+  sm_type state_machine;
+  std::uint64_t sum{0};
+
+  collector() : state_machine{*this} {
+    state_machine.template init<collecting>();
+  }
+};
+
+//--------------------------------------------------------
+// Helpers
+//--------------------------------------------------------
+
+template <typename F>
+double events_per_sec(std::size_t events, F &&f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return events / elapsed.count();
+}
+
+template <typename Machine, typename Allocator>
+typename Machine::batch make_batch(const Allocator &alloc, std::size_t records,
+                                   std::size_t i) {
+  typename Machine::batch input{typename Machine::records_type(alloc)};
+  input.records.reserve(records);
+  for (std::size_t r = 0; r < records; ++r) {
+    input.records.push_back({r, i});
+  }
+  return input;
+}
+
+//--------------------------------------------------------
+// Main
+//--------------------------------------------------------
+
+void bench_payloads(std::size_t events, std::size_t records,
+                    std::size_t batch_size) {
+  using heap = collector<lsm::policies::no_arena>;
+  using pooled = collector<lsm::policies::arena_payloads<>>;
+
+  // the input is copied to the callback
+  heap copied;
+  std::allocator<heap::record> heap_alloc;
+  auto start = heap_allocations;
+  auto copy_rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      auto input = make_batch<heap>(heap_alloc, records, i);
+      copied.state_machine.transit(input);
+    }
+  });
+  auto copy_allocs = heap_allocations - start;
+
+  // the input is moved to the callback
+  heap moved;
+  start = heap_allocations;
+  auto move_rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      moved.state_machine.transit(make_batch<heap>(heap_alloc, records, i));
+    }
+  });
+  auto move_allocs = heap_allocations - start;
+
+  // payloads allocated from the arena, released after each batch
+  pooled arena;
+  auto &payloads = arena.state_machine.arena();
+  lsm::arena_allocator<pooled::record> arena_alloc{payloads};
+
+  // warm up: chunks are kept for the next batches
+  for (std::size_t i = 0; i < batch_size; ++i) {
+    arena.state_machine.transit(make_batch<pooled>(arena_alloc, records, i));
+  }
+  payloads.release();
+  arena.sum = 0;
+
+  start = heap_allocations;
+  auto arena_rate = events_per_sec(events, [&] {
+    for (std::size_t i = 0; i < events; ++i) {
+      arena.state_machine.transit(
+          make_batch<pooled>(arena_alloc, records, i));
+      if (i % batch_size == batch_size - 1) {
+        payloads.release();
+      }
+    }
+  });
+  auto arena_allocs = heap_allocations - start;
+
+  if (copied.sum != moved.sum || moved.sum != arena.sum) {
+    std::cerr << "[-] payloads: sums differ" << std::endl;
+  }
+
+  std::cout << "payload inputs (" << records << " records)" << std::endl;
+  std::cout << "  copied          : " << copy_rate << " events/s, "
+            << double(copy_allocs) / events << " allocations/event"
+            << std::endl;
+  std::cout << "  moved           : " << move_rate << " events/s, "
+            << double(move_allocs) / events << " allocations/event"
+            << std::endl;
+  std::cout << "  moved, arena    : " << arena_rate << " events/s, "
+            << double(arena_allocs) / events << " allocations/event"
+            << std::endl;
+}
+
+int main() {
+  bench_payloads(1000000, 32, 1024);
+  return 0;
+}
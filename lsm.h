@@ -14,8 +14,15 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
 #include <stdexcept>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <functional>
 
@@ -38,6 +45,76 @@ struct nonsuch {
     nonsuch(const nonsuch &) = delete;
     void operator=(const nonsuch &) = delete;
 };
+
+// detection idiom
+namespace details {
+template <typename Default, typename AlwaysVoid,
+          template <typename...> typename Op, typename... Args>
+struct detector {
+    using value_t = std::false_type;
+    using type = Default;
+};
+
+template <typename Default, template <typename...> typename Op,
+          typename... Args>
+struct detector<Default, std::void_t<Op<Args...>>, Op, Args...> {
+    using value_t = std::true_type;
+    using type = Op<Args...>;
+};
+}  // namespace details
+
+template <template <typename...> typename Op, typename... Args>
+constexpr bool is_detected_v =
+    details::detector<nonsuch, void, Op, Args...>::value_t::value;
+
+template <typename Default, template <typename...> typename Op,
+          typename... Args>
+using detected_or_t =
+    typename details::detector<Default, void, Op, Args...>::type;
+
+// smallest unsigned type able to hold values in [0..Max]
+template <std::size_t Max>
+using smallest_uint_t = std::conditional_t<
+    (Max <= UINT8_MAX), std::uint8_t,
+    std::conditional_t<(Max <= UINT16_MAX), std::uint16_t,
+                       std::conditional_t<(Max <= UINT32_MAX), std::uint32_t,
+                                          std::uint64_t>>>;
+
+// type name taken from the compiler function signature
+template <typename T>
+constexpr std::string_view type_name() {
+#if defined(__clang__) || defined(__GNUC__)
+    constexpr std::string_view sig = __PRETTY_FUNCTION__;
+    constexpr auto first = sig.find("T = ") + 4;
+    constexpr auto last = sig.find_first_of(";]", first);
+#elif defined(_MSC_VER)
+    constexpr std::string_view sig = __FUNCSIG__;
+    constexpr auto first = sig.find("type_name<") + 10;
+    constexpr auto last = sig.rfind(">(void)");
+#else
+    constexpr std::string_view sig = "unknown";
+    constexpr std::size_t first = 0;
+    constexpr auto last = sig.size();
+#endif
+    return sig.substr(first, last - first);
+}
+
+// 64 bits FNV-1a hash
+constexpr std::uint64_t fnv1a(std::string_view str) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto c : str) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// FNV-1a step over the bytes of value, least significant first
+constexpr std::uint64_t fnv1a(std::uint64_t hash, std::uint64_t value) {
+    for (std::size_t b = 0; b < sizeof(value); ++b) {
+        hash = (hash ^ ((value >> (8 * b)) & 0xff)) * 1099511628211ull;
+    }
+    return hash;
+}
 }  // namespace lsm::utilities
 
 //--------------------------------------------------------
@@ -147,81 +224,133 @@ template <typename List>
 using pop_back_t = typename pop_back<List>::type;
 
 namespace details {
-template <typename Item, typename List, bool = is_empty_v<List>>
-struct push_back_impl;
+// position of the first true value, count if none
+template <std::size_t N>
+constexpr std::size_t find_first(const bool (&values)[N]) {
+    std::size_t i = 0;
+    while (i < N - 1 && !values[i]) {
+        ++i;
+    }
+    return i;
+}
 
-template <typename Item, typename List>
-struct push_back_impl<Item, List, false> {
-    using type =
-        push_front_t<front_t<List>,
-                     typename push_back_impl<Item, pop_front_t<List>>::type>;
+template <typename Item>
+struct item_tag {};
+
+template <typename... Items>
+struct item_set : item_tag<Items>... {};
+
+// accumulator of distinct items, folded over item tags
+template <template <typename...> typename List, typename... Items>
+struct unique_acc {
+    using type = List<Items...>;
 };
 
-template <typename Item, typename List>
-struct push_back_impl<Item, List, true> {
-    using type = push_front_t<Item, List>;
+template <template <typename...> typename List, typename... Items,
+          typename Item>
+auto operator+(unique_acc<List, Items...>, item_tag<Item>)
+    -> std::conditional_t<
+        std::is_base_of_v<item_tag<Item>, item_set<Items...>>,
+        unique_acc<List, Items...>, unique_acc<List, Items..., Item>>;
+
+// list wrapper, folded to concatenate lists
+template <typename List>
+struct list_tag {
+    using type = List;
 };
+
+template <template <typename...> typename List, typename... Items1,
+          typename... Items2>
+auto operator+(list_tag<List<Items1...>>, list_tag<List<Items2...>>)
+    -> list_tag<List<Items1..., Items2...>>;
+
+// random access through overload resolution on indexed bases
+template <std::size_t I, typename Item>
+struct indexed_item {
+    using type = Item;
+};
+
+template <typename Seq, typename... Items>
+struct indexed_items;
+
+template <std::size_t... Is, typename... Items>
+struct indexed_items<std::index_sequence<Is...>, Items...>
+    : indexed_item<Is, Items>... {};
+
+template <std::size_t I, typename Item>
+indexed_item<I, Item> select_item(const indexed_item<I, Item> &);
 }  // namespace details
 
 template <typename Item, typename List>
-struct push_back : details::push_back_impl<Item, List> {};
+struct push_back;
+
+template <typename Item, template <typename...> typename List,
+          typename... Items>
+struct push_back<Item, List<Items...>> {
+    using type = List<Items..., Item>;
+};
 
 template <typename Item, typename List>
 using push_back_t = typename push_back<Item, List>::type;
 
-template <typename Item, typename List, bool = is_empty_v<List>>
-struct has {
-    static constexpr bool value =
-        !is_empty_v<List> && (std::is_same<Item, robust_front_t<List>>::value ||
-                              has<Item, pop_front_t<List>>::value);
+template <typename Item, typename List>
+struct has;
+
+template <typename Item, template <typename...> typename List,
+          typename... Items>
+struct has<Item, List<Items...>> {
+    static constexpr bool value = (std::is_same_v<Item, Items> || ...);
 };
 
 template <typename Item, typename List>
-struct has<Item, List, false> {
-    static constexpr bool value = std::is_same_v<Item, front_t<List>> ||
-                                  has<Item, pop_front_t<List>>::value;
-};
+constexpr bool has_v = has<Item, List>::value;
 
 template <typename Item, typename List>
-struct has<Item, List, true> {
-    static constexpr bool value = false;
+struct index_of;
+
+template <typename Item, template <typename...> typename List,
+          typename... Items>
+struct index_of<Item, List<Items...>> {
+    // equals size of the list if the item is not found
+    static constexpr std::size_t value =
+        details::find_first({std::is_same_v<Item, Items>..., true});
 };
 
 template <typename Item, typename List>
-constexpr bool has_v = has<Item, List>::value;
+constexpr std::size_t index_of_v = index_of<Item, List>::value;
 
-template <typename List, bool = (size_v<List>> 1)>
-struct remove_dup;
+template <std::size_t I, typename List>
+struct at;
 
-template <typename List>
-struct remove_dup<List, true> {
-    using Head = front_t<List>;
-    using Tail = pop_front_t<List>;
-    using type =
-        std::conditional_t<has_v<Head, Tail>, typename remove_dup<Tail>::type,
-                           push_front_t<Head, typename remove_dup<Tail>::type>>;
+template <std::size_t I, template <typename...> typename List,
+          typename... Items>
+struct at<I, List<Items...>> {
+    static_assert(I < sizeof...(Items), "list index out of range");
+    using type = typename decltype(details::select_item<I>(
+        details::indexed_items<std::index_sequence_for<Items...>,
+                               Items...>{}))::type;
 };
 
+template <std::size_t I, typename List>
+using at_t = typename at<I, List>::type;
+
+// keeps the first occurrence of each item
 template <typename List>
-struct remove_dup<List, false> {
-    using type = List;
+struct remove_dup;
+
+template <template <typename...> typename List, typename... Items>
+struct remove_dup<List<Items...>> {
+    using type = typename decltype((details::unique_acc<List>{} + ... +
+                                    details::item_tag<Items>{}))::type;
 };
 
 template <typename List>
 using remove_dup_t = typename remove_dup<List>::type;
 
-template <typename List1, typename List2, bool = is_empty_v<List2>>
-struct concat;
-
-template <typename List1, typename List2>
-struct concat<List1, List2, false> {
-    using type = push_front_t<front_t<List2>,
-                              typename concat<List1, pop_front_t<List2>>::type>;
-};
-
 template <typename List1, typename List2>
-struct concat<List1, List2, true> {
-    using type = List1;
+struct concat {
+    using type = typename decltype(details::list_tag<List1>{} +
+                                   details::list_tag<List2>{})::type;
 };
 
 template <typename List1, typename List2>
@@ -231,16 +360,9 @@ template <typename List1, typename List2>
 using merge_t = remove_dup_t<concat_t<List1, List2>>;
 
 template <typename... Lists>
-struct concat_all;
-
-template <typename L1, typename L2, typename... Ls>
-struct concat_all<L1, L2, Ls...> {
-    using type = concat_t<L1, typename concat_all<L2, Ls...>::type>;
-};
-
-template <typename L>
-struct concat_all<L> {
-    using type = L;
+struct concat_all {
+    using type =
+        typename decltype((details::list_tag<Lists>{} + ...))::type;
 };
 
 template <typename... Lists>
@@ -267,198 +389,2020 @@ struct mplist {};
 //--------------------------------------------------------
 
 namespace lsm::details {
-// state type aggregator
-template <typename List, bool = lsm::list::is_empty_v<List>>
+// state type aggregator, source states ordered by first appearance
+// followed by target only states
+template <typename List>
 struct set_state_types_aggregator;
 
-template <typename List>
-struct set_state_types_aggregator<List, false> {
-    using head = lsm::list::front_t<List>;
-    using type =
-        lsm::list::merge_t<lsm::list::mplist<typename head::source_state_type,
-                                             typename head::target_state_type>,
-                           typename set_state_types_aggregator<
-                               lsm::list::pop_front_t<List>>::type>;
+template <template <typename...> typename List, typename... Txs>
+struct set_state_types_aggregator<List<Txs...>> {
+    using type = lsm::list::remove_dup_t<
+        lsm::list::mplist<typename Txs::source_state_type...,
+                          typename Txs::target_state_type...>>;
 };
 
 template <typename List>
-struct set_state_types_aggregator<List, true> {
-    using type = lsm::list::mplist<>;
+using set_state_types_aggregator_t =
+    typename set_state_types_aggregator<List>::type;
+
+// input type aggregator, inputs are ordered by first appearance
+template <typename List>
+struct set_input_types_aggregator;
+
+template <template <typename...> typename List, typename... Txs>
+struct set_input_types_aggregator<List<Txs...>> {
+    using type = lsm::list::remove_dup_t<
+        lsm::list::mplist<typename Txs::input_type...>>;
 };
 
 template <typename List>
-using set_state_types_aggregator_t =
-    typename set_state_types_aggregator<List>::type;
+using set_input_types_aggregator_t =
+    typename set_input_types_aggregator<List>::type;
 
-// transition finder
-template <typename State, typename Input, typename List,
-          bool = lsm::list::is_empty_v<List>>
-struct tx_finder;
+// index of the first transition of each (state, input) pair, computed once
+// per table, the number of transitions stands for no transition
+template <typename List>
+struct tx_index_table;
 
-template <typename State, typename Input, typename List>
-struct tx_finder<State, Input, List, false> {
-    using current_tx = lsm::list::front_t<List>;
-    using type = std::conditional_t<
-        std::is_same_v<State, typename current_tx::source_state_type> &&
-            std::is_same_v<Input, typename current_tx::input_type>,
-        current_tx,
-        typename tx_finder<State, Input, lsm::list::pop_front_t<List>>::type>;
+template <template <typename...> typename List, typename... Txs>
+struct tx_index_table<List<Txs...>> {
+    using state_types = set_state_types_aggregator_t<List<Txs...>>;
+    using input_types = set_input_types_aggregator_t<List<Txs...>>;
+
+    static constexpr std::size_t state_count =
+        lsm::list::size_v<state_types>;
+    static constexpr std::size_t input_count =
+        lsm::list::size_v<input_types>;
+
+    // (state, input) indexes of each transition
+    static constexpr std::array<std::size_t, sizeof...(Txs)> source_index = {
+        lsm::list::index_of_v<typename Txs::source_state_type,
+                              state_types>...};
+    static constexpr std::array<std::size_t, sizeof...(Txs)> input_index = {
+        lsm::list::index_of_v<typename Txs::input_type, input_types>...};
+
+   private:
+    static constexpr auto make() {
+        std::array<std::size_t, state_count * input_count> table{};
+        for (auto &i : table) {
+            i = sizeof...(Txs);
+        }
+
+        for (std::size_t tx = sizeof...(Txs); tx-- > 0;) {
+            table[source_index[tx] * input_count + input_index[tx]] = tx;
+        }
+        return table;
+    }
+
+    static constexpr auto make_next() {
+        std::array<std::size_t, state_count * input_count> last{};
+        for (auto &i : last) {
+            i = sizeof...(Txs);
+        }
+
+        std::array<std::size_t, sizeof...(Txs)> next{};
+        for (std::size_t tx = sizeof...(Txs); tx-- > 0;) {
+            auto key = source_index[tx] * input_count + input_index[tx];
+            next[tx] = last[key];
+            last[key] = tx;
+        }
+        return next;
+    }
+
+   public:
+    // first transition of each (state, input) pair
+    static constexpr auto value = make();
+
+    // next transition with the same (state, input) pair
+    static constexpr auto next = make_next();
+
+    // transitions followed by nonsuch, for random access by index
+    using transitions = lsm::list::details::indexed_items<
+        std::index_sequence_for<Txs..., utilities::nonsuch>, Txs...,
+        utilities::nonsuch>;
+};
+
+// transition lookup for the table of descriptor Desc: templates taking the
+// whole transition list as argument are costly to instantiate for large
+// tables, so per (state, input) templates are only keyed on Desc
+template <typename Desc>
+struct tx_lookup {
+    using table_type = typename Desc::transition_table;
+    using index_table = tx_index_table<table_type>;
+
+    template <typename State, typename Input>
+    static constexpr std::size_t index() {
+        constexpr auto s =
+            lsm::list::index_of_v<State, typename index_table::state_types>;
+        constexpr auto i =
+            lsm::list::index_of_v<Input, typename index_table::input_types>;
+
+        if constexpr (s < index_table::state_count &&
+                      i < index_table::input_count) {
+            return index_table::value[s * index_table::input_count + i];
+        } else {
+            return lsm::list::size_v<table_type>;
+        }
+    }
+
+    template <typename State, typename Input>
+    using type = typename decltype(lsm::list::details::select_item<
+                                   index<State, Input>()>(
+        typename index_table::transitions{}))::type;
+
+   private:
+    template <typename State, typename Input>
+    static constexpr std::size_t candidate(std::size_t n) {
+        auto tx = index<State, Input>();
+        while (n-- > 0) {
+            tx = index_table::next[tx];
+        }
+        return tx;
+    }
+
+    template <typename State, typename Input>
+    static constexpr std::size_t candidate_count() {
+        std::size_t n = 0;
+        for (auto tx = index<State, Input>();
+             tx < lsm::list::size_v<table_type>; tx = index_table::next[tx]) {
+            ++n;
+        }
+        return n;
+    }
+
+    template <typename State, typename Input, std::size_t... Ns>
+    static auto make_candidates(std::index_sequence<Ns...>)
+        -> lsm::list::mplist<typename decltype(lsm::list::details::select_item<
+                                               candidate<State, Input>(Ns)>(
+            typename index_table::transitions{}))::type...>;
+
+   public:
+    // every transition of a (state, input) pair, in table order
+    template <typename State, typename Input>
+    using candidates = decltype(make_candidates<State, Input>(
+        std::make_index_sequence<candidate_count<State, Input>()>{}));
+};
+
+template <typename List>
+struct table_desc {
+    using transition_table = List;
 };
 
+// transition finder, first transition matching (state, input)
 template <typename State, typename Input, typename List>
-struct tx_finder<State, Input, List, true> {
-    using type = utilities::nonsuch;
+struct tx_finder {
+    using type = typename tx_lookup<table_desc<List>>::template type<State,
+                                                                     Input>;
 };
 
 template <typename State, typename Input, typename List>
 using tx_finder_t = typename tx_finder<State, Input, List>::type;
-}  // namespace lsm::details
 
-//--------------------------------------------------------
-// State machine traits
-//--------------------------------------------------------
+// instrumented code of a transition: the whole transition, or each of
+// its hooks (exit, enter) and its callback (apply)
+enum class probe_kind { transition, exit, enter, apply };
 
-namespace lsm::traits {
-template <typename T>
-struct state_machine_traits {
-    using transition_table_type = typename T::transition_table;
-    using state_list_type = list::rebind_t<
-        std::variant,
-        details::set_state_types_aggregator_t<transition_table_type>>;
+// instrumentation disabled, probes compile to nothing
+struct no_recorder {
+    struct probe {};
+
+    template <probe_kind Kind>
+    probe start() {
+        return {};
+    }
+
+    template <probe_kind Kind>
+    void stop(std::size_t, std::size_t, probe) {}
+
+    void rejected(std::size_t, std::size_t) {}
 };
-}  // namespace lsm::traits
+
+// journaling disabled, records compile to nothing
+struct no_journal {
+    template <typename Input>
+    void record(std::size_t, const Input &) {}
+
+    void enter() {}
+
+    void leave() {}
+
+    static constexpr bool callbacks() { return true; }
+};
+
+// no payload arena
+struct no_arena {};
+
+// no state timeouts
+struct no_timers {
+    template <typename State, typename Front>
+    void rearm(Front &) {}
+};
+
+// current state not published, observers are not supported
+struct no_publisher {
+    void publish(std::size_t) {}
+};
+
+// current state index published for observer threads, a single atomic
+// store (a plain store on x86) per state change
+template <typename Index>
+class state_publisher {
+   public:
+    void publish(std::size_t index) {
+        m_index.store(static_cast<Index>(index), std::memory_order_release);
+    }
+
+    std::size_t load() const {
+        return m_index.load(std::memory_order_acquire);
+    }
+
+   private:
+    std::atomic<Index> m_index{0};
+};
+}  // namespace lsm::details
 
 //--------------------------------------------------------
-// State machine engine implementation
+// Policies
 //--------------------------------------------------------
 
-namespace lsm {
+namespace lsm::policies {
 ///
-///@brief Type used to describe transitions
+/// @brief Dispatch transit through std::visit on the current state
 ///
-template <typename... Ts>
-using transition_table_type = list::mplist<Ts...>;
+struct visit_dispatch {};
 
 ///
-/// @brief Base structure used for state definition
+/// @brief Dispatch transit through a constexpr (state, input) table of
+/// function pointers, i.e. a single indexed indirect call per event
 ///
-struct base_state {
-    virtual void on_enter() {
-        // no op
-    }
+struct table_dispatch {};
 
-    virtual void on_exit() {
-        // no op
-    }
-};
+///
+/// @brief Hold the current state only (std::variant), states are destroyed
+/// on exit and default constructed on enter
+///
+struct variant_storage {};
 
 ///
-/// @brief Base state machine descriptor
+/// @brief Hold every state for the machine lifetime (std::tuple), a
+/// transition only changes the active index and calls the hooks
 ///
-template <typename Base>
-class state_machine_desc {
-   private:
-    template <typename SourceState, typename Input, typename TargetState>
-    struct base_transition {
-        using source_state_type = SourceState;
-        using input_type = Input;
-        using target_state_type = TargetState;
-    };
+struct persistent_storage {};
 
-   public:
-    state_machine_desc() = default;
-    state_machine_desc(const state_machine_desc &) = delete;
-    state_machine_desc &operator=(const state_machine_desc &) = delete;
+///
+/// @brief Report rejected transitions to the runtime error handler
+/// (std::function, throws std::runtime_error by default)
+///
+struct function_error {};
 
-    template <typename SourceState, typename Input, typename TargetState,
-              auto Func>
-    struct transition_cb : base_transition<SourceState, Input, TargetState> {
-        template <typename SM, typename... Args>
-        static auto apply(SM &sm, Args &&... args) {
-            return (sm.*Func)(std::forward<Args>(args)...);
-        }
-    };
+///
+/// @brief Silently drop rejected transitions
+///
+struct ignore_error {};
 
-    template <typename SourceState, typename Input, typename TargetState>
-    struct transition : base_transition<SourceState, Input, TargetState> {
-        template <typename VM, typename Arg>
-        static void apply([[maybe_unused]] VM &vm, [[maybe_unused]] Arg arg) {
-            // sink
-        }
-    };
+///
+/// @brief Drop rejected transitions, transit returns false for them
+///
+struct status_error {};
 
-    // To be continued... Create new transition type here suited to your needs
+///
+/// @brief Call Handler(state_index, input_index) on rejected transitions,
+/// input_index is the number of inputs if the input is not in the table
+///
+template <auto Handler>
+struct static_error {
+    static void on_error(std::size_t state_index, std::size_t input_index) {
+        Handler(state_index, input_index);
+    }
 };
 
 ///
-/// @brief Base state machine frontend
+/// @brief No transition instrumentation
 ///
-template <typename T>
-class state_machine_front {
-   public:
-    using traits_type = traits::state_machine_traits<T>;
-    using table_type = typename traits_type::transition_table_type;
-    using state_list_type = typename traits_type::state_list_type;
-    using error_handler_type = std::function<void(const std::string&)>;
+/// An instrumentation policy provides a recorder<States, Inputs> type
+/// whose probes time each transition applied or each of its hooks and
+/// its callback (see lsm_stats.h)
+///
+struct no_instrumentation {
+    template <typename States, typename Inputs>
+    using recorder = details::no_recorder;
+};
 
-    void set_error_handler(const error_handler_type& h) {
-        m_error_handler = h;
-    }
+///
+/// @brief No input journal
+///
+/// A journal policy provides a journal<Inputs> type that records the
+/// inputs applied to the machine (see lsm_journal.h)
+///
+struct no_journal {
+    template <typename Inputs>
+    using journal = details::no_journal;
+};
 
-   private:
+///
+/// @brief Input payloads are allocated by their owner
+///
+/// An arena policy provides an arena type held by the front, payloads of
+/// a batch of inputs are allocated from it and released together (see
+/// lsm_arena.h)
+///
+struct no_arena {
+    using arena = details::no_arena;
+};
 
-    struct default_handler {
-        void operator()(const std::string& msg) {
-            throw std::runtime_error(msg.c_str());
-        }
-    };
+///
+/// @brief No state timeouts
+///
+/// A timer policy provides a timers<Front> type held by the front that
+/// arms the timeout of each state entered (see lsm_timer.h)
+///
+struct no_timeouts {
+    template <typename Front>
+    using timers = details::no_timers;
+};
 
-    T &m_sm;
-    state_list_type m_current_state;
-    error_handler_type m_error_handler = default_handler();
+///
+/// @brief Current state only readable by the thread running transit
+///
+struct unobserved_state {
+    template <typename Index>
+    using publisher = details::no_publisher;
+};
 
-    template <typename State, typename Input>
-    void apply_transition(const Input &input) {
-        using tx = details::tx_finder_t<State, Input, table_type>;
+///
+/// @brief Publish the current state index atomically on each state change
+/// so that other threads can read it through a state_observer without
+/// locks
+///
+struct observable_state {
+    template <typename Index>
+    using publisher = details::state_publisher<Index>;
+};
 
-        if constexpr (!std::is_same_v<tx, utilities::nonsuch>) {
-            using next_state = typename tx::target_state_type;
+///
+/// @brief Apply inputs as soon as transit is called
+///
+struct immediate_events {};
 
-            if (!std::is_same_v<next_state, State>) {
-                // exit state
-                std::get<State>(m_current_state).on_exit();
+///
+/// @brief Run to completion: inputs posted while a transition is running
+/// and deferred inputs are kept in rings of Capacity inputs inside the
+/// front and applied once the current transition completes
+///
+template <std::size_t Capacity>
+struct queued_events {
+    static_assert(Capacity > 0, "event ring capacity must not be null");
+    static constexpr std::size_t capacity = Capacity;
+};
+}  // namespace lsm::policies
 
-                // enter new state
-                m_current_state = next_state();
-                std::get<next_state>(m_current_state).on_enter();
-            }
+//--------------------------------------------------------
+// State storage
+//--------------------------------------------------------
 
-            // apply transition
-            tx::apply(m_sm, input);
-        } else {
-            // For your needs, you could add custom error handler to this class
-            // easily
-            m_error_handler("bad transition");
-        }
-    }
+namespace lsm::details {
+template <typename StateList, typename Policy>
+class state_storage;
 
+template <typename... States>
+class state_storage<lsm::list::mplist<States...>, policies::variant_storage> {
    public:
-    state_machine_front(T &sm) : m_sm{sm} {}
+    std::size_t index() const { return m_states.index(); }
 
     template <typename State>
-    void init() {
-        m_current_state = State();
-        std::get<State>(m_current_state).on_enter();
+    State &get() {
+        return *std::get_if<State>(&m_states);
     }
 
-    template <typename Input>
-    void transit(const Input &input) {
-        std::visit(
-            [this, &input](auto &&arg) {
-                using S = std::decay_t<decltype(arg)>;
-                this->apply_transition<S, Input>(input);
+    template <typename State>
+    State &activate() {
+        return m_states.template emplace<State>();
+    }
+
+    template <typename F>
+    decltype(auto) visit(F &&f) {
+        return std::visit(std::forward<F>(f), m_states);
+    }
+
+   private:
+    std::variant<States...> m_states;
+};
+
+template <typename... States>
+class state_storage<lsm::list::mplist<States...>,
+                    policies::persistent_storage> {
+   public:
+    std::size_t index() const { return m_index; }
+
+    template <typename State>
+    State &get() {
+        return std::get<State>(m_states);
+    }
+
+    template <typename State>
+    State &activate() {
+        m_index = lsm::list::index_of_v<State, lsm::list::mplist<States...>>;
+        return get<State>();
+    }
+
+    template <typename F>
+    decltype(auto) visit(F &&f) {
+        using first_state = lsm::list::front_t<lsm::list::mplist<States...>>;
+        using result_type = decltype(f(std::declval<first_state &>()));
+        using thunk_type = result_type (*)(std::tuple<States...> &, F &);
+
+        static constexpr thunk_type thunks[] = {
+            [](std::tuple<States...> &states, F &func) -> result_type {
+                return func(std::get<States>(states));
+            }...};
+        return thunks[m_index](m_states, f);
+    }
+
+   private:
+    std::tuple<States...> m_states;
+    std::size_t m_index{0};
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Event ring
+//--------------------------------------------------------
+
+namespace lsm::details {
+// fixed capacity FIFO of input variants stored inline (no allocation)
+template <typename Variant, std::size_t Capacity>
+class event_ring {
+   public:
+    bool empty() const { return m_size == 0; }
+
+    std::size_t size() const { return m_size; }
+
+    bool full() const { return m_size == Capacity; }
+
+    // the input is left untouched if the ring is full
+    template <typename Input>
+    bool push(Input &&input) {
+        if (full()) {
+            return false;
+        }
+
+        m_events[wrap(m_head + m_size)].template emplace<std::decay_t<Input>>(
+            std::forward<Input>(input));
+        ++m_size;
+        return true;
+    }
+
+    Variant pop() {
+        Variant event = std::move(m_events[m_head]);
+        m_events[m_head].template emplace<0>();
+        m_head = wrap(m_head + 1);
+        --m_size;
+        return event;
+    }
+
+   private:
+    static std::size_t wrap(std::size_t i) {
+        return i < Capacity ? i : i - Capacity;
+    }
+
+    std::array<Variant, Capacity> m_events{};
+    std::size_t m_head{0};
+    std::size_t m_size{0};
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Hierarchical state machines
+//--------------------------------------------------------
+
+namespace lsm::details {
+// A composite state is a state type with its own transition_table, its
+// initial substate is initial_state if declared, else its first state.
+// Composite states are flattened into their leaf states at compile time.
+
+template <typename State>
+using transition_table_t = typename State::transition_table;
+
+template <typename State>
+constexpr bool is_composite_v =
+    utilities::is_detected_v<transition_table_t, State>;
+
+template <typename State>
+using initial_state_t = typename State::initial_state;
+
+template <typename Composite>
+using composite_initial_t = utilities::detected_or_t<
+    lsm::list::front_t<set_state_types_aggregator_t<
+        typename Composite::transition_table>>,
+    initial_state_t, Composite>;
+
+// leaf reached when entering State, with the composites entered on the way
+// (outermost first)
+template <typename State, bool = is_composite_v<State>>
+struct entry_path {
+    using leaf = State;
+    using composites = lsm::list::mplist<>;
+};
+
+template <typename State>
+struct entry_path<State, true> {
+    using inner = entry_path<composite_initial_t<State>>;
+    using leaf = typename inner::leaf;
+    using composites =
+        lsm::list::push_front_t<State, typename inner::composites>;
+};
+
+// leaf of State with the composites exited when leaving State from it
+// (innermost first)
+template <typename Leaf, typename Exits>
+struct leaf_path {
+    using leaf = Leaf;
+    using exits = Exits;
+};
+
+template <typename Composite, typename Paths>
+struct exit_through;
+
+template <typename Composite, typename... Paths>
+struct exit_through<Composite, lsm::list::mplist<Paths...>> {
+    using type = lsm::list::mplist<
+        leaf_path<typename Paths::leaf,
+                  lsm::list::push_back_t<Composite, typename Paths::exits>>...>;
+};
+
+template <typename State, bool = is_composite_v<State>>
+struct leaf_paths {
+    using type = lsm::list::mplist<leaf_path<State, lsm::list::mplist<>>>;
+};
+
+template <typename Composite, typename States>
+struct substate_leaf_paths;
+
+template <typename Composite, typename... States>
+struct substate_leaf_paths<Composite, lsm::list::mplist<States...>> {
+    using type = lsm::list::concat_all_t<
+        lsm::list::mplist<>,
+        typename exit_through<Composite,
+                              typename leaf_paths<States>::type>::type...>;
+};
+
+template <typename State>
+struct leaf_paths<State, true> {
+    using type = typename substate_leaf_paths<
+        State, set_state_types_aggregator_t<
+                   typename State::transition_table>>::type;
+};
+
+// deferred transitions keep their input until the state changes
+template <typename Tx>
+using deferred_t = decltype(Tx::deferred);
+
+template <typename Tx>
+constexpr bool is_deferred_v = std::remove_cv_t<
+    utilities::detected_or_t<std::false_type, deferred_t, Tx>>::value;
+
+// compiler independent hash of the structure of a (flattened) table: state
+// and input counts, then the source, input and target indexes of each
+// transition in table order and whether it is deferred
+template <typename List>
+struct table_structure;
+
+template <template <typename...> typename List, typename... Txs>
+struct table_structure<List<Txs...>> {
+    using state_types = set_state_types_aggregator_t<List<Txs...>>;
+    using input_types = set_input_types_aggregator_t<List<Txs...>>;
+
+    static constexpr std::uint64_t hash() {
+        auto h = utilities::fnv1a(utilities::fnv1a(""),
+                                  lsm::list::size_v<state_types>);
+        h = utilities::fnv1a(h, lsm::list::size_v<input_types>);
+        ((h = tx_hash<Txs>(h)), ...);
+        return h;
+    }
+
+   private:
+    template <typename Tx>
+    static constexpr std::uint64_t tx_hash(std::uint64_t h) {
+        using lsm::list::index_of_v;
+        h = utilities::fnv1a(
+            h, index_of_v<typename Tx::source_state_type, state_types>);
+        h = utilities::fnv1a(h,
+                             index_of_v<typename Tx::input_type, input_types>);
+        h = utilities::fnv1a(
+            h, index_of_v<typename Tx::target_state_type, state_types>);
+        return utilities::fnv1a(h, is_deferred_v<Tx>);
+    }
+};
+
+// transition Tx of Owner's table seen from one leaf of its source state
+template <typename Owner, typename Tx, typename Source, typename Exits,
+          typename Target, typename Enters>
+struct flat_transition {
+    static constexpr std::bool_constant<is_deferred_v<Tx>> deferred{};
+    using owner_type = Owner;
+    using source_state_type = Source;
+    using input_type = typename Tx::input_type;
+    using target_state_type = Target;
+    using exit_composites = Exits;
+    using enter_composites = Enters;
+
+    // only declared when Tx has a guard
+    template <typename SM, typename Arg, typename U = Tx>
+    static constexpr auto guard(SM &sm, const Arg &arg)
+        -> decltype(U::guard(sm, arg)) {
+        return U::guard(sm, arg);
+    }
+
+    template <typename SM, typename... Args>
+    static constexpr void apply(SM &sm, Args &&... args) {
+        Tx::apply(sm, std::forward<Args>(args)...);
+    }
+};
+
+template <typename Owner, typename Tx, typename Paths>
+struct flatten_tx;
+
+template <typename Owner, typename Tx, typename... Paths>
+struct flatten_tx<Owner, Tx, lsm::list::mplist<Paths...>> {
+    using target = entry_path<typename Tx::target_state_type>;
+    using type = lsm::list::mplist<
+        flat_transition<Owner, Tx, typename Paths::leaf,
+                        typename Paths::exits, typename target::leaf,
+                        typename target::composites>...>;
+};
+
+// flattened table of Owner: nested tables first so that inner transitions
+// take precedence over the parent ones for the same (leaf, input)
+template <typename Owner, typename Table = typename Owner::transition_table,
+          typename States = set_state_types_aggregator_t<Table>>
+struct flatten_table;
+
+template <typename State, bool = is_composite_v<State>>
+struct flatten_nested {
+    using type = lsm::list::mplist<>;
+    using composites = lsm::list::mplist<>;
+};
+
+template <typename State>
+struct flatten_nested<State, true> {
+    using type = typename flatten_table<State>::type;
+    using composites = lsm::list::push_front_t<
+        State, typename flatten_table<State>::composites>;
+};
+
+template <typename Owner, template <typename...> typename List,
+          typename... Txs, typename... States>
+struct flatten_table<Owner, List<Txs...>, lsm::list::mplist<States...>> {
+    using type = lsm::list::concat_all_t<
+        lsm::list::mplist<>, typename flatten_nested<States>::type...,
+        typename flatten_tx<Owner, Txs,
+                            typename leaf_paths<
+                                typename Txs::source_state_type>::type>::
+            type...>;
+    using composites = lsm::list::remove_dup_t<lsm::list::concat_all_t<
+        lsm::list::mplist<>, typename flatten_nested<States>::composites...>>;
+};
+
+template <typename States>
+struct has_composite;
+
+template <typename... States>
+struct has_composite<lsm::list::mplist<States...>>
+    : std::bool_constant<(is_composite_v<States> || ...)> {};
+
+// descriptor of the flattened table of T, flat tables are used as is
+template <typename T,
+          bool = has_composite<set_state_types_aggregator_t<
+              typename T::transition_table>>::value>
+struct flat_desc {
+    using transition_table = typename T::transition_table;
+    using composites = lsm::list::mplist<>;
+};
+
+template <typename T>
+struct flat_desc<T, true> {
+    using transition_table = typename flatten_table<T>::type;
+    using composites = typename flatten_table<T>::composites;
+};
+
+// one instance of each composite state for the lifetime of the machine,
+// used as the context of the transitions of its table and for its hooks
+template <typename Composites>
+class composite_set;
+
+template <typename... Composites>
+class composite_set<lsm::list::mplist<Composites...>> {
+   public:
+    template <typename Composite>
+    constexpr Composite &get() {
+        return std::get<Composite>(m_composites);
+    }
+
+   private:
+    std::tuple<Composites...> m_composites;
+};
+
+template <typename Tx>
+using owner_type_t = typename Tx::owner_type;
+
+template <typename Tx>
+using exit_composites_t = typename Tx::exit_composites;
+
+template <typename Tx>
+using enter_composites_t = typename Tx::enter_composites;
+
+// descriptor whose members are called by Tx
+template <typename Tx, typename Root>
+using owner_t = utilities::detected_or_t<Root, owner_type_t, Tx>;
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// State machine traits
+//--------------------------------------------------------
+
+namespace lsm::traits {
+namespace details {
+template <typename T>
+using dispatch_policy_t = typename T::dispatch_policy;
+
+template <typename T>
+using storage_policy_t = typename T::storage_policy;
+
+template <typename T>
+using error_policy_t = typename T::error_policy;
+
+template <typename T>
+using event_policy_t = typename T::event_policy;
+
+template <typename T>
+using instrumentation_policy_t = typename T::instrumentation_policy;
+
+template <typename T>
+using journal_policy_t = typename T::journal_policy;
+
+template <typename T>
+using arena_policy_t = typename T::arena_policy;
+
+template <typename T>
+using observer_policy_t = typename T::observer_policy;
+
+template <typename T>
+using timer_policy_t = typename T::timer_policy;
+}  // namespace details
+
+template <typename T>
+struct state_machine_traits {
+    // composite states are flattened, the table only holds leaf states
+    using desc_type = lsm::details::flat_desc<T>;
+    using transition_table_type = typename desc_type::transition_table;
+    using composite_types = typename desc_type::composites;
+    using state_types = lsm::details::set_state_types_aggregator_t<
+        transition_table_type>;
+    using input_types = lsm::details::set_input_types_aggregator_t<
+        transition_table_type>;
+    using state_list_type = list::rebind_t<std::variant, state_types>;
+    using state_index_type =
+        utilities::smallest_uint_t<list::size_v<state_types>>;
+    // optional descriptor policies
+    using dispatch_policy =
+        utilities::detected_or_t<policies::visit_dispatch,
+                                 details::dispatch_policy_t, T>;
+    using storage_policy =
+        utilities::detected_or_t<policies::variant_storage,
+                                 details::storage_policy_t, T>;
+    using storage_type =
+        lsm::details::state_storage<state_types, storage_policy>;
+    using error_policy =
+        utilities::detected_or_t<policies::function_error,
+                                 details::error_policy_t, T>;
+    using event_policy =
+        utilities::detected_or_t<policies::immediate_events,
+                                 details::event_policy_t, T>;
+    using instrumentation_policy =
+        utilities::detected_or_t<policies::no_instrumentation,
+                                 details::instrumentation_policy_t, T>;
+    using journal_policy =
+        utilities::detected_or_t<policies::no_journal,
+                                 details::journal_policy_t, T>;
+    using arena_policy =
+        utilities::detected_or_t<policies::no_arena,
+                                 details::arena_policy_t, T>;
+    using observer_policy =
+        utilities::detected_or_t<policies::unobserved_state,
+                                 details::observer_policy_t, T>;
+    using timer_policy =
+        utilities::detected_or_t<policies::no_timeouts,
+                                 details::timer_policy_t, T>;
+
+    // first transition from State on Input, utilities::nonsuch if none
+    template <typename State, typename Input>
+    using transition_t = typename lsm::details::tx_lookup<
+        desc_type>::template type<State, Input>;
+
+    // all transitions from State on Input, in table order
+    template <typename State, typename Input>
+    using transitions_t = typename lsm::details::tx_lookup<
+        desc_type>::template candidates<State, Input>;
+};
+}  // namespace lsm::traits
+
+//--------------------------------------------------------
+// State machine engine implementation
+//--------------------------------------------------------
+
+namespace lsm {
+///
+///@brief Type used to describe transitions
+///
+template <typename... Ts>
+using transition_table_type = list::mplist<Ts...>;
+
+///
+/// @brief Base structure used for state definition
+///
+/// Deriving from it is optional: any default constructible type can be
+/// used as a state, on_enter/on_exit are called (without virtual dispatch)
+/// only if the state type defines them.
+///
+struct base_state {
+    virtual void on_enter() {
+        // no op
+    }
+
+    virtual void on_exit() {
+        // no op
+    }
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// State hooks
+//--------------------------------------------------------
+
+namespace lsm::details {
+template <typename State>
+using on_enter_t = decltype(std::declval<State &>().on_enter());
+
+template <typename State>
+using on_exit_t = decltype(std::declval<State &>().on_exit());
+
+template <typename Tx, typename SM, typename Input>
+using guard_t = decltype(Tx::guard(std::declval<SM &>(),
+                                   std::declval<const Input &>()));
+
+// hooks inherited from base_state without override are no op
+template <typename State>
+constexpr void enter_state([[maybe_unused]] State &state) {
+    if constexpr (utilities::is_detected_v<on_enter_t, State>) {
+        if constexpr (!std::is_same_v<decltype(&State::on_enter),
+                                      decltype(&base_state::on_enter)>) {
+            state.State::on_enter();
+        }
+    }
+}
+
+template <typename State>
+constexpr void exit_state([[maybe_unused]] State &state) {
+    if constexpr (utilities::is_detected_v<on_exit_t, State>) {
+        if constexpr (!std::is_same_v<decltype(&State::on_exit),
+                                      decltype(&base_state::on_exit)>) {
+            state.State::on_exit();
+        }
+    }
+}
+
+// rejected transition reporting selected by the error policy
+template <typename ErrorPolicy>
+class error_reporter {
+   public:
+    void report(std::size_t state_index, std::size_t input_index) {
+        if constexpr (!std::is_same_v<ErrorPolicy, policies::ignore_error> &&
+                      !std::is_same_v<ErrorPolicy, policies::status_error>) {
+            ErrorPolicy::on_error(state_index, input_index);
+        }
+    }
+};
+
+template <>
+class error_reporter<policies::function_error> {
+   public:
+    using handler_type = std::function<void(const std::string &)>;
+
+    void set_handler(const handler_type &h) { m_handler = h; }
+
+    void report(std::size_t, std::size_t) { m_handler("bad transition"); }
+
+   private:
+    struct default_handler {
+        void operator()(const std::string &msg) {
+            throw std::runtime_error(msg.c_str());
+        }
+    };
+
+    handler_type m_handler = default_handler();
+};
+}  // namespace lsm::details
+
+namespace lsm {
+
+///
+/// @brief Base state machine descriptor
+///
+template <typename Base>
+class state_machine_desc {
+   private:
+    template <typename SourceState, typename Input, typename TargetState>
+    struct base_transition {
+        using source_state_type = SourceState;
+        using input_type = Input;
+        using target_state_type = TargetState;
+    };
+
+   public:
+    state_machine_desc() = default;
+    state_machine_desc(const state_machine_desc &) = delete;
+    state_machine_desc &operator=(const state_machine_desc &) = delete;
+
+    template <typename SourceState, typename Input, typename TargetState,
+              auto Func>
+    struct transition_cb : base_transition<SourceState, Input, TargetState> {
+        template <typename SM, typename... Args>
+        static constexpr auto apply(SM &sm, Args &&... args) {
+            return (sm.*Func)(std::forward<Args>(args)...);
+        }
+    };
+
+    template <typename SourceState, typename Input, typename TargetState>
+    struct transition : base_transition<SourceState, Input, TargetState> {
+        template <typename VM, typename Arg>
+        static constexpr void apply([[maybe_unused]] VM &vm,
+                                    [[maybe_unused]] Arg &&arg) {
+            // sink
+        }
+    };
+
+    // Transitions of the same (source, input) pair are tried in table
+    // order, the first one whose guard returns true is taken
+    template <typename SourceState, typename Input, typename TargetState,
+              auto Guard, auto Func = nullptr>
+    struct transition_guard
+        : base_transition<SourceState, Input, TargetState> {
+        template <typename SM, typename Arg>
+        static constexpr bool guard(SM &sm, const Arg &arg) {
+            return (sm.*Guard)(arg);
+        }
+
+        template <typename SM, typename... Args>
+        static constexpr void apply([[maybe_unused]] SM &sm,
+                                    [[maybe_unused]] Args &&... args) {
+            if constexpr (!std::is_same_v<decltype(Func), std::nullptr_t>) {
+                (sm.*Func)(std::forward<Args>(args)...);
+            }
+        }
+    };
+
+    // Input is kept while the current state is State and applied again
+    // after the next state change (requires the queued_events policy)
+    template <typename State, typename Input>
+    struct defer : base_transition<State, Input, State> {
+        static constexpr std::true_type deferred{};
+
+        template <typename SM, typename Arg>
+        static void apply([[maybe_unused]] SM &sm,
+                          [[maybe_unused]] Arg &&arg) {
+            // sink
+        }
+    };
+
+    // To be continued... Create new transition type here suited to your needs
+};
+
+///
+/// @brief Base state machine frontend
+///
+template <typename T>
+class state_machine_front {
+   public:
+    using traits_type = traits::state_machine_traits<T>;
+    using table_type = typename traits_type::transition_table_type;
+    using state_list_type = typename traits_type::state_list_type;
+    using input_types = typename traits_type::input_types;
+    using dispatch_policy = typename traits_type::dispatch_policy;
+    using storage_type = typename traits_type::storage_type;
+    using error_policy = typename traits_type::error_policy;
+    using event_policy = typename traits_type::event_policy;
+    using instrumentation_policy =
+        typename traits_type::instrumentation_policy;
+    using recorder_type = typename instrumentation_policy::template recorder<
+        typename traits_type::state_types, input_types>;
+    using journal_policy = typename traits_type::journal_policy;
+    using journal_type =
+        typename journal_policy::template journal<input_types>;
+    using arena_policy = typename traits_type::arena_policy;
+    using arena_type = typename arena_policy::arena;
+    using observer_policy = typename traits_type::observer_policy;
+    using publisher_type = typename observer_policy::template publisher<
+        typename traits_type::state_index_type>;
+    using timer_policy = typename traits_type::timer_policy;
+    using timer_type =
+        typename timer_policy::template timers<state_machine_front>;
+    using error_handler_type = std::function<void(const std::string&)>;
+
+    void set_error_handler(const error_handler_type& h) {
+        static_assert(std::is_same_v<error_policy, policies::function_error>,
+                      "error handler requires the function_error policy");
+        m_errors.set_handler(h);
+    }
+
+   private:
+    static constexpr bool has_event_queue =
+        !std::is_same_v<event_policy, policies::immediate_events>;
+    static constexpr bool has_journal =
+        !std::is_same_v<journal_policy, policies::no_journal>;
+
+    using event_type = list::rebind_t<
+        std::variant, list::push_front_t<std::monostate, input_types>>;
+
+    template <typename Policy>
+    struct event_queue {
+        details::event_ring<event_type, Policy::capacity> posted;
+        details::event_ring<event_type, Policy::capacity> deferred;
+        bool running{false};
+    };
+
+    struct no_event_queue {};
+
+    using event_queue_type = std::conditional_t<
+        has_event_queue, event_queue<event_policy>, no_event_queue>;
+
+    // flags a running transition until the scope is left
+    struct running_scope {
+        explicit running_scope(bool &running) : m_running{running} {
+            m_running = true;
+        }
+
+        ~running_scope() { m_running = false; }
+
+        bool &m_running;
+    };
+
+    // flags a transit in progress to the journal until the scope is left
+    struct journal_scope {
+        explicit journal_scope(journal_type &journal) : m_journal{journal} {
+            m_journal.enter();
+        }
+
+        ~journal_scope() { m_journal.leave(); }
+
+        journal_type &m_journal;
+    };
+
+    T &m_sm;
+    storage_type m_current_state;
+    // right after the storage: with small states a state change dirties
+    // the line of the index and of the published index only, large
+    // states (or persistent storage, whose index follows all the states)
+    // put them on different cache lines
+    publisher_type m_publisher;
+    details::composite_set<typename traits_type::composite_types> m_composites;
+    details::error_reporter<error_policy> m_errors;
+    event_queue_type m_events;
+    recorder_type m_recorder;
+    journal_type m_journal;
+    arena_type m_arena;
+    timer_type m_timers;
+
+    // the index of the state is published to observers, the state object
+    // itself is only accessed by the thread running transit, the timeout
+    // of the previous state is replaced by the one of State
+    template <typename State>
+    State &activate() {
+        m_publisher.publish(
+            list::index_of_v<State, typename traits_type::state_types>);
+        m_timers.template rearm<State>(*this);
+        return m_current_state.template activate<State>();
+    }
+
+    void on_error(std::size_t input_index) {
+        m_recorder.rejected(m_current_state.index(), input_index);
+        m_errors.report(m_current_state.index(), input_index);
+    }
+
+    // returns false if the transition was rejected, an rvalue input is
+    // moved to the callback of the transition applied
+    template <typename State, typename Input>
+    bool apply_transition(Input &&input) {
+        using input_type = std::decay_t<Input>;
+        using candidates =
+            typename traits_type::template transitions_t<State, input_type>;
+
+        if (apply_candidates<State>(std::forward<Input>(input),
+                                    candidates{})) {
+            return true;
+        }
+
+        on_error(list::index_of_v<input_type, input_types>);
+        return false;
+    }
+
+    // candidates are tried in table order, the first unguarded one or
+    // the first one whose guard passes is applied (and only that one may
+    // move the input)
+    template <typename State, typename Input, typename... Txs>
+    bool apply_candidates(Input &&input, list::mplist<Txs...>) {
+        return (apply_tx<State, Txs>(std::forward<Input>(input)) || ...);
+    }
+
+    template <typename State, typename Tx, typename Input>
+    bool apply_tx(Input &&input) {
+        using owner = details::owner_t<Tx, T>;
+        using input_type = std::decay_t<Input>;
+
+        if constexpr (details::is_deferred_v<Tx>) {
+            static_assert(has_event_queue,
+                          "deferred inputs require the queued_events policy");
+            if constexpr (has_event_queue) {
+                // rejected if the ring is full, the input is only moved
+                // once a slot is free so the next candidates still get it
+                if (m_events.deferred.full()) {
+                    return false;
+                }
+                m_events.deferred.push(std::forward<Input>(input));
+                return true;
+            }
+        } else if constexpr (utilities::is_detected_v<details::guard_t, Tx,
+                                                      owner, input_type>) {
+            if (!Tx::guard(context<Tx>(), input)) {
+                return false;
+            }
+        }
+
+        using next_state = typename Tx::target_state_type;
+        using exits = utilities::detected_or_t<
+            list::mplist<>, details::exit_composites_t, Tx>;
+        using enters = utilities::detected_or_t<
+            list::mplist<>, details::enter_composites_t, Tx>;
+
+        // the transition and its callback are recorded against the source
+        // state, the hooks against the state left or entered
+        [[maybe_unused]] const auto state_idx = m_current_state.index();
+        constexpr auto input_idx = list::index_of_v<input_type, input_types>;
+        auto probe =
+            m_recorder.template start<details::probe_kind::transition>();
+
+        if (!std::is_same_v<next_state, State> || !list::is_empty_v<exits> ||
+            !list::is_empty_v<enters>) {
+            // exit state, then the composite states left
+            auto exit_probe =
+                m_recorder.template start<details::probe_kind::exit>();
+            if (m_journal.callbacks()) {
+                details::exit_state(m_current_state.template get<State>());
+                exit_composites(exits{});
+            }
+            m_recorder.template stop<details::probe_kind::exit>(
+                state_idx, input_idx, exit_probe);
+
+            // enter the composite states reached, then new state
+            auto enter_probe =
+                m_recorder.template start<details::probe_kind::enter>();
+            if (m_journal.callbacks()) {
+                enter_composites(enters{});
+            }
+            auto &next = activate<next_state>();
+            if (m_journal.callbacks()) {
+                details::enter_state(next);
+            }
+            m_recorder.template stop<details::probe_kind::enter>(
+                m_current_state.index(), input_idx, enter_probe);
+        }
+
+        // apply transition
+        auto apply_probe =
+            m_recorder.template start<details::probe_kind::apply>();
+        if (m_journal.callbacks()) {
+            Tx::apply(context<Tx>(), std::forward<Input>(input));
+        }
+        m_recorder.template stop<details::probe_kind::apply>(
+            state_idx, input_idx, apply_probe);
+        m_recorder.template stop<details::probe_kind::transition>(
+            state_idx, input_idx, probe);
+        return true;
+    }
+
+    // descriptor or composite state whose members are called by Tx
+    template <typename Tx>
+    auto &context() {
+        using owner = details::owner_t<Tx, T>;
+
+        if constexpr (std::is_same_v<owner, T>) {
+            return m_sm;
+        } else {
+            return m_composites.template get<owner>();
+        }
+    }
+
+    template <typename... Composites>
+    void exit_composites(list::mplist<Composites...>) {
+        (details::exit_state(m_composites.template get<Composites>()), ...);
+    }
+
+    template <typename... Composites>
+    void enter_composites(list::mplist<Composites...>) {
+        (details::enter_state(m_composites.template get<Composites>()), ...);
+    }
+
+    // jump table dispatch
+    using thunk_type = bool (*)(state_machine_front &, const void *);
+
+    // Ref is a const lvalue reference, or an rvalue reference to an input
+    // that may be moved from
+    template <typename State, typename Ref>
+    static bool dispatch_thunk(state_machine_front &self, const void *input) {
+        using value_type = std::remove_reference_t<Ref>;
+        return self.apply_transition<State>(static_cast<Ref>(
+            *static_cast<value_type *>(const_cast<void *>(input))));
+    }
+
+    template <typename Input, bool Move>
+    using input_ref_t =
+        std::conditional_t<Move, Input &&, const Input &>;
+
+    template <typename State, bool Move, typename... Inputs>
+    static constexpr auto make_dispatch_row(list::mplist<Inputs...>) {
+        return std::array<thunk_type, sizeof...(Inputs)>{
+            &dispatch_thunk<State, input_ref_t<Inputs, Move>>...};
+    }
+
+    template <bool Move, typename... States>
+    static constexpr auto make_dispatch_table(list::mplist<States...>) {
+        return std::array<
+            std::array<thunk_type, list::size_v<input_types>>,
+            sizeof...(States)>{
+            make_dispatch_row<States, Move>(input_types{})...};
+    }
+
+    // rows are indexed by variant state index, columns by input index,
+    // only instantiated with the table_dispatch policy
+    template <bool Move>
+    static const auto &dispatch_table() {
+        static constexpr auto table =
+            make_dispatch_table<Move>(typename traits_type::state_types{});
+        return table;
+    }
+
+    // batch dispatch: consume inputs while the state does not change,
+    // returns the first input that has not been consumed yet
+    template <typename State, typename Input>
+    const Input *apply_run(const Input *first, const Input *last) {
+        // state lookup is hoisted out of the loop
+        const auto idx = m_current_state.index();
+        do {
+            apply_transition<State>(*first);
+        } while (++first != last && m_current_state.index() == idx);
+        return first;
+    }
+
+    template <typename Input>
+    using run_thunk_type = const Input *(*)(state_machine_front &,
+                                            const Input *, const Input *);
+
+    template <typename Input, typename State>
+    static const Input *run_thunk(state_machine_front &self,
+                                  const Input *first, const Input *last) {
+        return self.apply_run<State, Input>(first, last);
+    }
+
+    template <typename Input, typename... States>
+    static constexpr auto make_run_table(list::mplist<States...>) {
+        return std::array<run_thunk_type<Input>, sizeof...(States)>{
+            &run_thunk<Input, States>...};
+    }
+
+    template <typename Input>
+    const Input *dispatch_run(const Input *first, const Input *last) {
+        if constexpr (std::is_same_v<dispatch_policy,
+                                     policies::table_dispatch>) {
+            static constexpr auto run_table = make_run_table<Input>(
+                typename traits_type::state_types{});
+            return run_table[m_current_state.index()](*this, first, last);
+        } else {
+            return m_current_state.visit([this, first, last](auto &&arg) {
+                using S = std::decay_t<decltype(arg)>;
+                return this->apply_run<S, Input>(first, last);
+            });
+        }
+    }
+
+    // both dispatch policies pass the same value category: an rvalue is
+    // moved, an lvalue or a const rvalue is passed as a const lvalue
+    template <typename Input>
+    bool dispatch(Input &&input) {
+        using input_type = std::decay_t<Input>;
+        constexpr bool move =
+            !std::is_lvalue_reference_v<Input> &&
+            !std::is_const_v<std::remove_reference_t<Input>>;
+
+        if constexpr (std::is_same_v<dispatch_policy,
+                                     policies::table_dispatch>) {
+            constexpr auto col = list::index_of_v<input_type, input_types>;
+
+            if constexpr (col < list::size_v<input_types>) {
+                return dispatch_table<move>()[m_current_state.index()][col](
+                    *this, &input);
+            } else {
+                // input does not appear in the transition table
+                on_error(col);
+                return false;
+            }
+        } else {
+            return m_current_state.visit([this, &input](auto &&arg) {
+                using S = std::decay_t<decltype(arg)>;
+                return this->apply_transition<S>(
+                    static_cast<input_ref_t<input_type, move>>(input));
+            });
+        }
+    }
+
+    // run to completion: inputs applied while a transition is running are
+    // queued and applied in order once it completes
+    template <typename Input>
+    bool run_to_completion(Input &&input) {
+        if (m_events.running) {
+            return post(std::forward<Input>(input));
+        }
+
+        running_scope scope{m_events.running};
+        auto idx = m_current_state.index();
+        bool done = dispatch(std::forward<Input>(input));
+        settle(idx);
+        return done;
+    }
+
+    template <typename Input>
+    bool post(Input &&input) {
+        using input_type = std::decay_t<Input>;
+
+        if constexpr (list::has_v<input_type, input_types>) {
+            if (m_events.posted.push(std::forward<Input>(input))) {
+                return true;
+            }
+        }
+
+        on_error(list::index_of_v<input_type, input_types>);
+        return false;
+    }
+
+    // deferred inputs are applied again after each state change, before
+    // the posted ones
+    void settle(std::size_t idx) {
+        for (;;) {
+            if (m_current_state.index() != idx &&
+                !m_events.deferred.empty()) {
+                idx = m_current_state.index();
+                for (auto n = m_events.deferred.size(); n != 0; --n) {
+                    dispatch_event(m_events.deferred.pop());
+                }
+            } else if (!m_events.posted.empty()) {
+                idx = m_current_state.index();
+                dispatch_event(m_events.posted.pop());
+            } else {
+                break;
+            }
+        }
+    }
+
+    void dispatch_event(event_type &&event) {
+        std::visit(
+            [this](auto &&arg) {
+                using I = std::decay_t<decltype(arg)>;
+                if constexpr (!std::is_same_v<I, std::monostate>) {
+                    this->dispatch(std::move(arg));
+                }
             },
-            m_current_state);
+            std::move(event));
+    }
+
+    // state activation by runtime index, without hooks
+    template <typename F, typename State>
+    static void restore_thunk(state_machine_front &self, F &f) {
+        f(self.template activate<State>());
+    }
+
+    template <typename F, typename... States>
+    static constexpr auto make_restore_table(list::mplist<States...>) {
+        return std::array<void (*)(state_machine_front &, F &),
+                          sizeof...(States)>{&restore_thunk<F, States>...};
+    }
+
+   public:
+    state_machine_front(T &sm) : m_sm{sm} {}
+
+    ///
+    /// @brief Recorder of the instrumentation policy
+    ///
+    const recorder_type &recorder() const { return m_recorder; }
+
+    ///
+    /// @brief Journal of the journal policy
+    ///
+    journal_type &journal() { return m_journal; }
+
+    ///
+    /// @brief Arena of the arena policy
+    ///
+    arena_type &arena() { return m_arena; }
+
+    ///
+    /// @brief State timeouts of the timer policy
+    ///
+    timer_type &timers() { return m_timers; }
+
+    ///
+    /// @brief Index of the current state in traits_type::state_types
+    ///
+    std::size_t index() const { return m_current_state.index(); }
+
+    template <typename State>
+    bool is() const {
+        return index() ==
+               list::index_of_v<State, typename traits_type::state_types>;
+    }
+
+    ///
+    /// @brief Current state published by the observer policy
+    ///
+    const publisher_type &publisher() const { return m_publisher; }
+
+    ///
+    /// @brief Call f with the current state
+    ///
+    template <typename F>
+    decltype(auto) visit_state(F &&f) {
+        return m_current_state.visit(std::forward<F>(f));
+    }
+
+    ///
+    /// @brief Make the state of the given index current without calling
+    /// its hooks, then call f with it (used to restore snapshots)
+    ///
+    /// @return false if the index is out of range
+    ///
+    template <typename F>
+    bool restore_state(std::size_t index, F &&f) {
+        using state_types = typename traits_type::state_types;
+        using func_type = std::remove_reference_t<F>;
+        static constexpr auto table =
+            make_restore_table<func_type>(state_types{});
+
+        if (index >= list::size_v<state_types>) {
+            return false;
+        }
+
+        table[index](*this, f);
+        return true;
+    }
+
+    ///
+    /// @brief Set the current state, a composite state is entered
+    /// down to its initial leaf state
+    ///
+    template <typename State>
+    void init() {
+        using path = details::entry_path<State>;
+        enter_composites(typename path::composites{});
+        details::enter_state(activate<typename path::leaf>());
+    }
+
+    ///
+    /// @brief Apply an input to the current state
+    ///
+    /// Returns whether the transition was applied with the status_error
+    /// policy, nothing otherwise. With the queued_events policy, an input
+    /// applied from a transition callback is queued (and reported as
+    /// applied) and the inputs queued are applied before transit returns.
+    /// An rvalue input is moved to the callback of the transition (or into
+    /// the event queue), never copied.
+    ///
+    template <typename Input>
+    auto transit(Input &&input) {
+        using input_type = std::decay_t<Input>;
+        [[maybe_unused]] bool done;
+
+        // inputs applied from transition callbacks are recorded as nested
+        m_journal.record(list::index_of_v<input_type, input_types>, input);
+        journal_scope scope{m_journal};
+
+        if constexpr (has_event_queue) {
+            done = run_to_completion(std::forward<Input>(input));
+        } else {
+            done = dispatch(std::forward<Input>(input));
+        }
+
+        if constexpr (std::is_same_v<error_policy, policies::status_error>) {
+            return done;
+        }
+    }
+
+    ///
+    /// @brief Apply a contiguous sequence of inputs of the same type
+    ///
+    /// Runs of self transitions are applied without looking up the
+    /// current state again for each input.
+    ///
+    template <typename Input>
+    void transit_range(const Input *first, const Input *last) {
+        if constexpr (has_event_queue || has_journal) {
+            // queued inputs are applied between the inputs of the range,
+            // journaled inputs are recorded one by one
+            for (; first != last; ++first) {
+                transit(*first);
+            }
+        } else if constexpr (list::has_v<Input, input_types>) {
+            while (first != last) {
+                first = dispatch_run(first, last);
+            }
+        } else {
+            for (; first != last; ++first) {
+                dispatch(*first);
+            }
+        }
+    }
+
+    template <typename Range>
+    void transit_range(const Range &inputs) {
+        auto first = std::data(inputs);
+        transit_range(first, first + std::size(inputs));
+    }
+
+    ///
+    /// @brief Apply several contiguous sequences in order, one per range
+    ///
+    template <typename... Ranges>
+    void transit_many(const Ranges &... inputs) {
+        (transit_range(inputs), ...);
+    }
+};
+
+///
+/// @brief Lock-free view of the current state of a machine, usable from
+/// any thread while another one runs transit
+///
+/// Requires the observable_state policy. The state read is the leaf state
+/// last activated, it may change as soon as it has been read.
+///
+template <typename T>
+class state_observer {
+   public:
+    using front_type = state_machine_front<T>;
+    using traits_type = typename front_type::traits_type;
+
+    static_assert(std::is_same_v<typename traits_type::observer_policy,
+                                 policies::observable_state>,
+                  "state observer requires the observable_state policy");
+
+    explicit state_observer(const front_type &front)
+        : m_publisher{&front.publisher()} {}
+
+    ///
+    /// @brief Index of the current state in traits_type::state_types
+    ///
+    std::size_t index() const { return m_publisher->load(); }
+
+    template <typename State>
+    bool is() const {
+        return index() ==
+               list::index_of_v<State, typename traits_type::state_types>;
+    }
+
+   private:
+    const typename front_type::publisher_type *m_publisher;
+};
+}  // namespace lsm
+//--------------------------------------------------------
+// Orthogonal regions
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Type used to list the transition tables of orthogonal regions
+///
+template <typename... Tables>
+using regions_type = list::mplist<Tables...>;
+}  // namespace lsm
+
+namespace lsm::details {
+// descriptor of region I of T, used as the key of the region traits
+template <typename T, std::size_t I>
+struct region_desc {
+    using transition_table = lsm::list::at_t<I, typename T::regions>;
+    using dispatch_policy =
+        utilities::detected_or_t<policies::visit_dispatch,
+                                 traits::details::dispatch_policy_t, T>;
+    using storage_policy =
+        utilities::detected_or_t<policies::variant_storage,
+                                 traits::details::storage_policy_t, T>;
+};
+
+template <typename T, typename Indexes>
+struct region_set;
+
+template <typename T, std::size_t... Is>
+struct region_set<T, std::index_sequence<Is...>> {
+    using storage_type = std::tuple<typename traits::state_machine_traits<
+        region_desc<T, Is>>::storage_type...>;
+    using input_types = lsm::list::remove_dup_t<lsm::list::concat_all_t<
+        lsm::list::mplist<>,
+        typename traits::state_machine_traits<
+            region_desc<T, Is>>::input_types...>>;
+};
+}  // namespace lsm::details
+
+namespace lsm {
+///
+/// @brief State machine frontend with one active state per region
+///
+/// T lists the transition tables of its regions in a regions member type
+/// (lsm::regions_type) instead of a transition_table. An input is applied
+/// to every region whose table uses its type, in region order, regions
+/// that do not know the input type are skipped at compile time. The input
+/// is rejected only if no region took a transition. Regions hold plain
+/// states, composite states are not supported in regions.
+///
+template <typename T>
+class region_machine_front {
+   public:
+    static constexpr std::size_t region_count =
+        list::size_v<typename T::regions>;
+
+    template <std::size_t I>
+    using region_traits_type =
+        traits::state_machine_traits<details::region_desc<T, I>>;
+
+    using input_types = typename details::region_set<
+        T, std::make_index_sequence<region_count>>::input_types;
+    using error_policy =
+        utilities::detected_or_t<policies::function_error,
+                                 traits::details::error_policy_t, T>;
+    using error_handler_type = std::function<void(const std::string &)>;
+
+    region_machine_front(T &sm) : m_sm{sm} {}
+
+    void set_error_handler(const error_handler_type &h) {
+        static_assert(std::is_same_v<error_policy, policies::function_error>,
+                      "error handler requires the function_error policy");
+        m_errors.set_handler(h);
+    }
+
+    ///
+    /// @brief Set the current state of every region, in region order
+    ///
+    template <typename... States>
+    void init() {
+        static_assert(sizeof...(States) == region_count,
+                      "one initial state is expected per region");
+        init_regions<States...>(std::make_index_sequence<region_count>{});
+    }
+
+    ///
+    /// @brief Apply an input to the regions that know its type
+    ///
+    /// Returns whether a region took a transition with the status_error
+    /// policy, nothing otherwise.
+    ///
+    template <typename Input>
+    auto transit(const Input &input) {
+        bool done =
+            dispatch_regions(input, std::make_index_sequence<region_count>{});
+
+        if (!done) {
+            // index of the first region state is reported
+            m_errors.report(std::get<0>(m_regions).index(),
+                            list::index_of_v<Input, input_types>);
+        }
+
+        if constexpr (std::is_same_v<error_policy, policies::status_error>) {
+            return done;
+        }
+    }
+
+    ///
+    /// @brief Index of the current state of region I
+    ///
+    template <std::size_t I>
+    std::size_t index() const {
+        return std::get<I>(m_regions).index();
+    }
+
+   private:
+    using storage_type = typename details::region_set<
+        T, std::make_index_sequence<region_count>>::storage_type;
+
+    T &m_sm;
+    storage_type m_regions;
+    details::error_reporter<error_policy> m_errors;
+
+    template <typename... States, std::size_t... Is>
+    void init_regions(std::index_sequence<Is...>) {
+        (init_region<Is, States>(), ...);
+    }
+
+    template <std::size_t I, typename State>
+    void init_region() {
+        static_assert(list::has_v<State, typename region_traits_type<
+                                             I>::state_types>,
+                      "initial state does not appear in its region");
+        static_assert(
+            list::is_empty_v<typename region_traits_type<I>::composite_types>,
+            "composite states are not supported in regions");
+        details::enter_state(
+            std::get<I>(m_regions).template activate<State>());
+    }
+
+    // all the regions are visited, without short circuit
+    template <typename Input, std::size_t... Is>
+    bool dispatch_regions(const Input &input, std::index_sequence<Is...>) {
+        bool done = false;
+        ((done = dispatch_region<Is>(input) || done), ...);
+        return done;
+    }
+
+    template <std::size_t I, typename Input>
+    bool dispatch_region([[maybe_unused]] const Input &input) {
+        using region_traits = region_traits_type<I>;
+
+        if constexpr (!list::has_v<Input,
+                                   typename region_traits::input_types>) {
+            return false;
+        } else if constexpr (std::is_same_v<
+                                 typename region_traits::dispatch_policy,
+                                 policies::table_dispatch>) {
+            static constexpr auto table = make_region_table<I, Input>(
+                typename region_traits::state_types{});
+            return table[std::get<I>(m_regions).index()](*this, input);
+        } else {
+            return std::get<I>(m_regions).visit([this, &input](auto &&arg) {
+                using S = std::decay_t<decltype(arg)>;
+                return this->apply_transition<I, S, Input>(input);
+            });
+        }
+    }
+
+    // one column of the jump table of region I, indexed by state index
+    template <std::size_t I, typename Input, typename... States>
+    static constexpr auto make_region_table(list::mplist<States...>) {
+        using thunk_type = bool (*)(region_machine_front &, const Input &);
+        return std::array<thunk_type, sizeof...(States)>{
+            &region_thunk<I, States, Input>...};
+    }
+
+    template <std::size_t I, typename State, typename Input>
+    static bool region_thunk(region_machine_front &self, const Input &input) {
+        return self.apply_transition<I, State, Input>(input);
+    }
+
+    template <std::size_t I, typename State, typename Input>
+    bool apply_transition(const Input &input) {
+        using candidates = typename region_traits_type<
+            I>::template transitions_t<State, Input>;
+        return apply_candidates<I, State>(input, candidates{});
+    }
+
+    template <std::size_t I, typename State, typename Input, typename... Txs>
+    bool apply_candidates(const Input &input, list::mplist<Txs...>) {
+        return (apply_tx<I, State, Txs>(input) || ...);
+    }
+
+    template <std::size_t I, typename State, typename Tx, typename Input>
+    bool apply_tx(const Input &input) {
+        static_assert(!details::is_deferred_v<Tx>,
+                      "deferred inputs are not supported in regions");
+
+        if constexpr (utilities::is_detected_v<details::guard_t, Tx, T,
+                                               Input>) {
+            if (!Tx::guard(m_sm, input)) {
+                return false;
+            }
+        }
+
+        using next_state = typename Tx::target_state_type;
+
+        if constexpr (!std::is_same_v<next_state, State>) {
+            auto &region = std::get<I>(m_regions);
+            details::exit_state(region.template get<State>());
+            details::enter_state(region.template activate<next_state>());
+        }
+
+        Tx::apply(m_sm, input);
+        return true;
+    }
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Constant evaluated state machines
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief State machine frontend usable in constant expressions
+///
+/// The front owns its descriptor and its states: no reference, no
+/// std::function and no virtual call, so init, transit and the state
+/// queries can be evaluated at compile time when the states, the inputs
+/// and the callbacks, guards and hooks reached are constexpr (hooks of
+/// base_state are virtual and cannot be). Inputs are applied immediately,
+/// the event, instrumentation and journal policies are not supported.
+///
+/// transit returns false when the input is rejected, after calling the
+/// static_error handler or throwing std::runtime_error with the default
+/// function_error policy (a compile error in a constant expression).
+///
+template <typename T>
+class constexpr_machine_front {
+   public:
+    using traits_type = traits::state_machine_traits<T>;
+    using state_types = typename traits_type::state_types;
+    using input_types = typename traits_type::input_types;
+    using storage_policy = typename traits_type::storage_policy;
+    using error_policy = typename traits_type::error_policy;
+
+    static_assert(std::is_same_v<typename traits_type::event_policy,
+                                 policies::immediate_events>,
+                  "constexpr_machine_front applies inputs immediately");
+
+    constexpr constexpr_machine_front() = default;
+
+    ///
+    /// @brief Descriptor whose members are called by the transitions
+    ///
+    constexpr T &desc() { return m_sm; }
+
+    constexpr const T &desc() const { return m_sm; }
+
+    ///
+    /// @brief Index of the current state in traits_type::state_types
+    ///
+    constexpr std::size_t index() const { return m_index; }
+
+    template <typename State>
+    constexpr bool is() const {
+        return m_index == list::index_of_v<State, state_types>;
+    }
+
+    ///
+    /// @brief Instance of a state, current or not
+    ///
+    template <typename State>
+    constexpr State &state() {
+        return std::get<State>(m_states);
+    }
+
+    template <typename State>
+    constexpr const State &state() const {
+        return std::get<State>(m_states);
+    }
+
+    ///
+    /// @brief Set the current state, a composite state is entered
+    /// down to its initial leaf state
+    ///
+    template <typename State>
+    constexpr void init() {
+        using path = details::entry_path<State>;
+        enter_composites(typename path::composites{});
+        details::enter_state(activate<typename path::leaf>());
+    }
+
+    ///
+    /// @brief Apply an input to the current state
+    ///
+    /// @return false if the input was rejected
+    ///
+    template <typename Input>
+    constexpr bool transit(const Input &input) {
+        if constexpr (list::has_v<Input, input_types>) {
+            if (dispatch(input, std::make_index_sequence<state_count>{})) {
+                return true;
+            }
+        }
+
+        constexpr auto input_idx = list::index_of_v<Input, input_types>;
+        if constexpr (std::is_same_v<error_policy,
+                                     policies::function_error>) {
+            throw std::runtime_error("bad transition");
+        } else if constexpr (!std::is_same_v<error_policy,
+                                             policies::ignore_error> &&
+                             !std::is_same_v<error_policy,
+                                             policies::status_error>) {
+            error_policy::on_error(m_index, input_idx);
+        }
+        return false;
+    }
+
+    ///
+    /// @brief Apply a sequence of inputs of the same type in order
+    ///
+    /// @return number of inputs applied, stops at the first rejected one
+    ///
+    template <typename Input>
+    constexpr std::size_t transit_range(const Input *first,
+                                        const Input *last) {
+        std::size_t count = 0;
+        for (; first != last && transit(*first); ++first) {
+            ++count;
+        }
+        return count;
+    }
+
+   private:
+    static constexpr std::size_t state_count = list::size_v<state_types>;
+
+    using composite_set_type =
+        details::composite_set<typename traits_type::composite_types>;
+
+    template <typename State>
+    constexpr State &activate() {
+        m_index = list::index_of_v<State, state_types>;
+        if constexpr (std::is_same_v<storage_policy,
+                                     policies::variant_storage>) {
+            // entered states are constructed again, as in a variant
+            state<State>() = State{};
+        }
+        return state<State>();
+    }
+
+    template <typename Input, std::size_t... Is>
+    constexpr bool dispatch(const Input &input, std::index_sequence<Is...>) {
+        bool done = false;
+        ((m_index == Is &&
+          (done = apply_candidates<list::at_t<Is, state_types>>(
+               input, typename traits_type::template transitions_t<
+                          list::at_t<Is, state_types>, Input>{}),
+           true)) ||
+         ...);
+        return done;
+    }
+
+    template <typename State, typename Input, typename... Txs>
+    constexpr bool apply_candidates(const Input &input, list::mplist<Txs...>) {
+        return (apply_tx<State, Txs>(input) || ...);
+    }
+
+    template <typename State, typename Tx, typename Input>
+    constexpr bool apply_tx(const Input &input) {
+        using owner = details::owner_t<Tx, T>;
+
+        static_assert(!details::is_deferred_v<Tx>,
+                      "deferred inputs require the queued_events policy");
+        if constexpr (utilities::is_detected_v<details::guard_t, Tx, owner,
+                                               Input>) {
+            if (!Tx::guard(context<Tx>(), input)) {
+                return false;
+            }
+        }
+
+        using next_state = typename Tx::target_state_type;
+        using exits = utilities::detected_or_t<
+            list::mplist<>, details::exit_composites_t, Tx>;
+        using enters = utilities::detected_or_t<
+            list::mplist<>, details::enter_composites_t, Tx>;
+
+        if constexpr (!std::is_same_v<next_state, State> ||
+                      !list::is_empty_v<exits> || !list::is_empty_v<enters>) {
+            details::exit_state(state<State>());
+            exit_composites(exits{});
+            enter_composites(enters{});
+            details::enter_state(activate<next_state>());
+        }
+
+        Tx::apply(context<Tx>(), input);
+        return true;
+    }
+
+    template <typename Tx>
+    constexpr auto &context() {
+        using owner = details::owner_t<Tx, T>;
+
+        if constexpr (std::is_same_v<owner, T>) {
+            return m_sm;
+        } else {
+            return m_composites.template get<owner>();
+        }
+    }
+
+    template <typename... Composites>
+    constexpr void exit_composites(list::mplist<Composites...>) {
+        (details::exit_state(m_composites.template get<Composites>()), ...);
+    }
+
+    template <typename... Composites>
+    constexpr void enter_composites(list::mplist<Composites...>) {
+        (details::enter_state(m_composites.template get<Composites>()), ...);
     }
+
+    T m_sm{};
+    list::rebind_t<std::tuple, state_types> m_states{};
+    composite_set_type m_composites{};
+    typename traits_type::state_index_type m_index{0};
 };
-}  // namespace lsm
\ No newline at end of file
+}  // namespace lsm
@@ -0,0 +1,189 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+///
+/// Payload arena for lsm state machines: inputs carrying containers (e.g.
+/// vectors of records) allocate them from an arena held by the front with
+/// arena_allocator, moved inputs reach the transition callbacks without a
+/// copy and a whole batch of payloads is released at once.
+///
+/// Payloads must not be used after release(), callbacks keeping records
+/// copy them to containers of their own. Deferred inputs still queued in
+/// the front hold arena memory as well.
+///
+
+//--------------------------------------------------------
+// Payload arena
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Monotonic arena of input payloads
+///
+/// Allocations bump a pointer in the current chunk, deallocation is a no
+/// op. Chunks are kept by release(), so batches no larger than the ones
+/// already seen are allocated without any heap allocation.
+///
+class payload_arena {
+   public:
+    explicit payload_arena(std::size_t chunk_size = 64 * 1024)
+        : m_chunk_size{std::max<std::size_t>(chunk_size, 64)} {}
+
+    payload_arena(const payload_arena &) = delete;
+    payload_arena &operator=(const payload_arena &) = delete;
+
+    void *allocate(std::size_t size, std::size_t align) {
+        auto p = align_up(m_cursor, align);
+        if (p == nullptr || p > m_end ||
+            size > static_cast<std::size_t>(m_end - p)) {
+            p = next_chunk(size, align);
+        }
+
+        m_cursor = p + size;
+        return p;
+    }
+
+    ///
+    /// @brief Release every payload allocated since the last release
+    ///
+    void release() {
+        m_current = 0;
+        if (!m_chunks.empty()) {
+            use(m_chunks.front());
+        }
+    }
+
+    ///
+    /// @brief Bytes reserved from the heap
+    ///
+    std::size_t capacity() const {
+        std::size_t bytes = 0;
+        for (const auto &c : m_chunks) {
+            bytes += c.size;
+        }
+        return bytes;
+    }
+
+   private:
+    struct chunk {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size;
+    };
+
+    static std::byte *align_up(std::byte *p, std::size_t align) {
+        auto addr = reinterpret_cast<std::uintptr_t>(p);
+        return p + ((align - addr % align) % align);
+    }
+
+    void use(chunk &c) {
+        m_cursor = c.data.get();
+        m_end = m_cursor + c.size;
+    }
+
+    // first chunk left that fits, a new one if none
+    std::byte *next_chunk(std::size_t size, std::size_t align) {
+        auto first = m_chunks.empty() ? 0 : m_current + 1;
+
+        for (auto i = first; i < m_chunks.size(); ++i) {
+            auto base = m_chunks[i].data.get();
+            auto p = align_up(base, align);
+            if (static_cast<std::size_t>(p - base) + size <= m_chunks[i].size) {
+                m_current = i;
+                use(m_chunks[i]);
+                return p;
+            }
+        }
+
+        auto bytes = std::max(m_chunk_size, size + align);
+        m_chunks.push_back({std::make_unique<std::byte[]>(bytes), bytes});
+        m_current = m_chunks.size() - 1;
+        use(m_chunks.back());
+        return align_up(m_cursor, align);
+    }
+
+    std::size_t m_chunk_size;
+    std::vector<chunk> m_chunks;
+    std::size_t m_current{0};
+    std::byte *m_cursor{nullptr};
+    std::byte *m_end{nullptr};
+};
+
+///
+/// @brief Standard allocator drawing from a payload arena
+///
+template <typename T>
+class arena_allocator {
+   public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    arena_allocator(payload_arena &arena) noexcept : m_arena{&arena} {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) noexcept
+        : m_arena{other.arena()} {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t) noexcept {
+        // released with the arena
+    }
+
+    payload_arena *arena() const { return m_arena; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U> &other) const {
+        return m_arena == other.arena();
+    }
+
+    template <typename U>
+    bool operator!=(const arena_allocator<U> &other) const {
+        return m_arena != other.arena();
+    }
+
+   private:
+    payload_arena *m_arena;
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Arena policy
+//--------------------------------------------------------
+
+namespace lsm::policies {
+///
+/// @brief Hold a payload arena of ChunkSize bytes chunks in the front,
+/// reached with arena()
+///
+template <std::size_t ChunkSize = 64 * 1024>
+struct arena_payloads {
+    struct arena : payload_arena {
+        arena() : payload_arena{ChunkSize} {}
+    };
+};
+}  // namespace lsm::policies
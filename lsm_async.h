@@ -0,0 +1,295 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+///
+/// Asynchronous transition actions for lsm state machines: a transition
+/// callback hands blocking work to an executor and returns at once, the
+/// machine is pending until the work completes and queues its inputs
+/// meanwhile. Completions are applied by the thread driving the machines,
+/// so a single thread can drive many machines waiting on I/O.
+///
+
+//--------------------------------------------------------
+// Executors
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Run the work on the calling thread
+///
+struct inline_executor {
+    void execute(std::function<void()> work) { work(); }
+};
+
+///
+/// @brief Fixed set of worker threads sharing a FIFO of work
+///
+class thread_pool_executor {
+   public:
+    explicit thread_pool_executor(
+        std::size_t threads = std::thread::hardware_concurrency()) {
+        for (std::size_t t = 0; t < std::max<std::size_t>(threads, 1); ++t) {
+            m_threads.emplace_back([this] { worker(); });
+        }
+    }
+
+    thread_pool_executor(const thread_pool_executor &) = delete;
+    thread_pool_executor &operator=(const thread_pool_executor &) = delete;
+
+    ~thread_pool_executor() {
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_quit = true;
+        }
+        m_wake.notify_all();
+
+        for (auto &t : m_threads) {
+            t.join();
+        }
+    }
+
+    void execute(std::function<void()> work) {
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_work.push_back(std::move(work));
+        }
+        m_wake.notify_one();
+    }
+
+   private:
+    void worker() {
+        for (;;) {
+            std::unique_lock<std::mutex> lk{m_mutex};
+            m_wake.wait(lk, [this] { return m_quit || !m_work.empty(); });
+
+            // pending work is done before quitting
+            if (m_work.empty()) {
+                return;
+            }
+
+            auto work = std::move(m_work.front());
+            m_work.pop_front();
+            lk.unlock();
+
+            work();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_work;
+    bool m_quit{false};
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Async context
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Executor shared by asynchronous machines, with the queue of
+/// the completions to apply on the driving thread
+///
+template <typename Executor>
+class async_context {
+   public:
+    explicit async_context(Executor &executor) : m_executor{executor} {}
+
+    async_context(const async_context &) = delete;
+    async_context &operator=(const async_context &) = delete;
+
+    ///
+    /// @brief Apply the completed actions, driving thread only
+    ///
+    /// @return number of completions applied
+    ///
+    std::size_t poll() {
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_ready.swap(m_running);
+        }
+
+        for (auto &completion : m_running) {
+            m_outstanding.fetch_sub(1, std::memory_order_relaxed);
+            completion();
+        }
+
+        auto count = m_running.size();
+        m_running.clear();
+        return count;
+    }
+
+    ///
+    /// @brief Apply completions until no action is outstanding
+    ///
+    void run() {
+        while (outstanding() != 0) {
+            {
+                std::unique_lock<std::mutex> lk{m_mutex};
+                m_done.wait(lk, [this] { return !m_ready.empty(); });
+            }
+            poll();
+        }
+    }
+
+    std::size_t outstanding() const {
+        return m_outstanding.load(std::memory_order_relaxed);
+    }
+
+   private:
+    template <typename, typename>
+    friend class async_machine;
+
+    template <typename Work, typename Completion>
+    void execute(Work &&work, Completion &&completion) {
+        m_outstanding.fetch_add(1, std::memory_order_relaxed);
+        m_executor.execute(
+            [this, work = std::forward<Work>(work),
+             completion = std::forward<Completion>(completion)]() mutable {
+                complete(completion(work));
+            });
+    }
+
+    void complete(std::function<void()> completion) {
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_ready.push_back(std::move(completion));
+        }
+        m_done.notify_one();
+    }
+
+    Executor &m_executor;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::vector<std::function<void()>> m_ready;
+    std::vector<std::function<void()>> m_running;
+    std::atomic<std::size_t> m_outstanding{0};
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Async machine
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief State machine whose transition callbacks may start
+/// asynchronous actions
+///
+/// A callback calls await(work): work runs on the executor and may return
+/// an input (or a variant of inputs) that is applied when it completes.
+/// Until then the machine is pending and the inputs it receives are
+/// queued in order. Work must not throw and must not touch the machine,
+/// the machine must outlive its outstanding actions.
+///
+template <typename T, typename Executor>
+class async_machine {
+   public:
+    using front_type = state_machine_front<T>;
+    using input_types = typename front_type::input_types;
+    using input_list_type = list::rebind_t<std::variant, input_types>;
+
+    async_machine(front_type &front, async_context<Executor> &context)
+        : m_front{front}, m_context{context} {}
+
+    async_machine(const async_machine &) = delete;
+    async_machine &operator=(const async_machine &) = delete;
+
+    ///
+    /// @brief Apply an input, queued if an action is pending
+    ///
+    template <typename Input>
+    void transit(const Input &input) {
+        static_assert(list::has_v<Input, input_types>,
+                      "input type does not appear in the transition table");
+
+        if (m_pending) {
+            m_backlog.emplace_back(input);
+        } else {
+            m_front.transit(input);
+        }
+    }
+
+    ///
+    /// @brief Start an asynchronous action, to be called from a
+    /// transition callback
+    ///
+    template <typename Work>
+    void await(Work &&work) {
+        m_pending = true;
+        m_context.execute(std::forward<Work>(work), [this](auto &w) {
+            using result_type = std::invoke_result_t<decltype(w)>;
+
+            if constexpr (std::is_void_v<result_type>) {
+                w();
+                return std::function<void()>{[this] { complete(); }};
+            } else {
+                return std::function<void()>{
+                    [this, result = w()] { complete(result); }};
+            }
+        });
+    }
+
+    bool pending() const { return m_pending; }
+
+    std::size_t backlog() const { return m_backlog.size(); }
+
+   private:
+    template <typename... Result>
+    void complete(const Result &... result) {
+        m_pending = false;
+        (apply(result), ...);
+
+        // queued inputs up to the next asynchronous action
+        while (!m_pending && !m_backlog.empty()) {
+            auto input = std::move(m_backlog.front());
+            m_backlog.pop_front();
+            apply(input);
+        }
+    }
+
+    template <typename Input>
+    void apply(const Input &input) {
+        if constexpr (list::has_v<Input, input_types>) {
+            m_front.transit(input);
+        } else {
+            std::visit([this](const auto &arg) { this->apply(arg); }, input);
+        }
+    }
+
+    front_type &m_front;
+    async_context<Executor> &m_context;
+    std::deque<input_list_type> m_backlog;
+    bool m_pending{false};
+};
+}  // namespace lsm
@@ -0,0 +1,416 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+///
+/// Runtime loaded state machines: states, inputs and transitions are read
+/// from a text description, interned as integer ids and compiled into a
+/// dense (state, input) table, so that an input is dispatched with a
+/// single indexed load. Callbacks are bound by name from C++.
+///
+/// Description, one declaration per line ('#' starts a comment):
+///   state <name>                  declare a state (optional)
+///   input <name>                  declare an input (optional)
+///   initial <state>               initial state (default: first state),
+///                                 declared or used by a transition
+///   transition <source> <input> <target> [<callback>]
+///   enter <state> <callback>      called when the state is entered
+///   exit <state> <callback>       called when the state is exited
+///
+/// States and inputs are numbered in order of first appearance. As with
+/// compile time tables, a transition to the same state does not call the
+/// enter and exit callbacks, and the callbacks of a transition are called
+/// in exit, enter, transition order.
+///
+
+//--------------------------------------------------------
+// Machine definition
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Compiled description of a runtime state machine, shared by any
+/// number of dynamic_machine instances
+///
+class machine_definition {
+   public:
+    static constexpr std::uint32_t npos =
+        std::numeric_limits<std::uint32_t>::max();
+
+    // (state, input) entry, target is npos if the input is rejected,
+    // callbacks are numbered from 1 (0 for none)
+    struct cell {
+        std::uint32_t target;
+        std::uint32_t callback;
+    };
+
+    ///
+    /// @brief Parse and compile a description
+    ///
+    /// Throws std::runtime_error on malformed descriptions and duplicate
+    /// (state, input) transitions.
+    ///
+    static machine_definition parse(std::string_view text) {
+        machine_definition def;
+        // transitions and callbacks, compiled once every state is known
+        std::vector<std::pair<std::size_t, std::vector<std::string_view>>>
+            decls;
+        // initial state, looked up once every state is known
+        std::string_view initial;
+        std::size_t initial_line = 0;
+
+        std::size_t line_number = 0;
+        while (!text.empty()) {
+            auto eol = text.find('\n');
+            auto line = text.substr(0, eol);
+            text = eol == std::string_view::npos ? std::string_view{}
+                                                 : text.substr(eol + 1);
+            ++line_number;
+
+            auto words = split(line.substr(0, line.find('#')));
+            if (words.empty()) {
+                continue;
+            }
+
+            auto keyword = words.front();
+            if (keyword == "state" && words.size() == 2) {
+                def.intern(def.m_states, def.m_state_ids, words[1]);
+            } else if (keyword == "input" && words.size() == 2) {
+                def.intern(def.m_inputs, def.m_input_ids, words[1]);
+            } else if (keyword == "initial" && words.size() == 2) {
+                initial = words[1];
+                initial_line = line_number;
+            } else if ((keyword == "enter" || keyword == "exit") &&
+                       words.size() == 3) {
+                decls.emplace_back(line_number, std::move(words));
+            } else if (keyword == "transition" &&
+                       (words.size() == 4 || words.size() == 5)) {
+                // states and inputs interned in order of appearance
+                def.intern(def.m_states, def.m_state_ids, words[1]);
+                def.intern(def.m_inputs, def.m_input_ids, words[2]);
+                def.intern(def.m_states, def.m_state_ids, words[3]);
+                decls.emplace_back(line_number, std::move(words));
+            } else {
+                error(line_number, "malformed declaration");
+            }
+        }
+
+        if (def.m_states.empty()) {
+            throw std::runtime_error("machine description without state");
+        }
+
+        if (initial_line != 0) {
+            def.m_initial = def.state_id(initial);
+            if (def.m_initial == npos) {
+                error(initial_line,
+                      "unknown initial state " + std::string{initial});
+            }
+        }
+
+        def.compile(decls);
+        return def;
+    }
+
+    std::size_t state_count() const { return m_states.size(); }
+
+    std::size_t input_count() const { return m_inputs.size(); }
+
+    std::size_t callback_count() const { return m_callbacks.size(); }
+
+    ///
+    /// @brief Id of a state, input or callback, npos if unknown
+    ///
+    std::uint32_t state_id(std::string_view name) const {
+        return find(m_state_ids, name);
+    }
+
+    std::uint32_t input_id(std::string_view name) const {
+        return find(m_input_ids, name);
+    }
+
+    std::uint32_t callback_id(std::string_view name) const {
+        return find(m_callback_ids, name);
+    }
+
+    const std::string &state_name(std::uint32_t id) const {
+        return m_states.at(id);
+    }
+
+    const std::string &input_name(std::uint32_t id) const {
+        return m_inputs.at(id);
+    }
+
+    const std::string &callback_name(std::uint32_t id) const {
+        return m_callbacks.at(id);
+    }
+
+    std::uint32_t initial_state() const { return m_initial; }
+
+    ///
+    /// @brief Table entry of (state, input), ids must be in range
+    ///
+    const cell &at(std::uint32_t state, std::uint32_t input) const {
+        return m_cells[state * m_inputs.size() + input];
+    }
+
+    ///
+    /// @brief Table of state_count() rows of input_count() entries
+    ///
+    const cell *cells() const { return m_cells.data(); }
+
+    ///
+    /// @brief Callbacks (numbered from 1, 0 for none) called when a
+    /// state is entered and exited
+    ///
+    std::uint32_t enter_callback(std::uint32_t state) const {
+        return m_enter[state];
+    }
+
+    std::uint32_t exit_callback(std::uint32_t state) const {
+        return m_exit[state];
+    }
+
+   private:
+    using id_map = std::unordered_map<std::string, std::uint32_t>;
+
+    machine_definition() = default;
+
+    [[noreturn]] static void error(std::size_t line, const std::string &msg) {
+        throw std::runtime_error("line " + std::to_string(line) + ": " +
+                                 msg);
+    }
+
+    static std::vector<std::string_view> split(std::string_view line) {
+        std::vector<std::string_view> words;
+        constexpr std::string_view blanks = " \t\r";
+
+        for (auto first = line.find_first_not_of(blanks);
+             first != std::string_view::npos;
+             first = line.find_first_not_of(blanks, first)) {
+            auto last = std::min(line.find_first_of(blanks, first),
+                                 line.size());
+            words.push_back(line.substr(first, last - first));
+            first = last;
+        }
+        return words;
+    }
+
+    static std::uint32_t find(const id_map &ids, std::string_view name) {
+        auto it = ids.find(std::string{name});
+        return it == ids.end() ? npos : it->second;
+    }
+
+    static std::uint32_t intern(std::vector<std::string> &names, id_map &ids,
+                                std::string_view name) {
+        auto inserted = ids.emplace(std::string{name},
+                                    static_cast<std::uint32_t>(names.size()));
+        if (inserted.second) {
+            names.emplace_back(name);
+        }
+        return inserted.first->second;
+    }
+
+    // callbacks are numbered from 1
+    std::uint32_t intern_callback(std::string_view name) {
+        return intern(m_callbacks, m_callback_ids, name) + 1;
+    }
+
+    void compile(const std::vector<std::pair<
+                     std::size_t, std::vector<std::string_view>>> &decls) {
+        if (m_initial == npos) {
+            m_initial = 0;
+        }
+
+        m_cells.assign(m_states.size() * m_inputs.size(), cell{npos, 0});
+        m_enter.assign(m_states.size(), 0);
+        m_exit.assign(m_states.size(), 0);
+
+        for (const auto &[line, words] : decls) {
+            if (words[0] != "transition") {
+                auto state = state_id(words[1]);
+                if (state == npos) {
+                    error(line, "unknown state " + std::string{words[1]});
+                }
+
+                auto &hook = words[0] == "enter" ? m_enter[state]
+                                                 : m_exit[state];
+                if (hook != 0) {
+                    error(line, "duplicate " + std::string{words[0]} +
+                                    " callback");
+                }
+                hook = intern_callback(words[2]);
+                continue;
+            }
+
+            auto &c = m_cells[state_id(words[1]) * m_inputs.size() +
+                              input_id(words[2])];
+            if (c.target != npos) {
+                error(line, "duplicate transition from " +
+                                std::string{words[1]} + " on " +
+                                std::string{words[2]});
+            }
+
+            c.target = state_id(words[3]);
+            c.callback = words.size() == 5 ? intern_callback(words[4]) : 0;
+        }
+    }
+
+    std::vector<std::string> m_states;
+    std::vector<std::string> m_inputs;
+    std::vector<std::string> m_callbacks;
+    id_map m_state_ids;
+    id_map m_input_ids;
+    id_map m_callback_ids;
+    std::vector<cell> m_cells;
+    std::vector<std::uint32_t> m_enter;
+    std::vector<std::uint32_t> m_exit;
+    std::uint32_t m_initial{npos};
+};
+
+//--------------------------------------------------------
+// Runtime state machine
+//--------------------------------------------------------
+
+///
+/// @brief Instance of a machine_definition, which must outlive it
+///
+/// Inputs carry an optional Payload passed to the callbacks. Callbacks
+/// left unbound are no op.
+///
+template <typename Payload = std::monostate>
+class dynamic_machine {
+   public:
+    using callback_type =
+        std::function<void(std::uint32_t input, const Payload &payload)>;
+
+    explicit dynamic_machine(const machine_definition &def)
+        : m_def{def},
+          m_cells{def.cells()},
+          m_input_count{static_cast<std::uint32_t>(def.input_count())},
+          m_callbacks(def.callback_count() + 1) {}
+
+    ///
+    /// @brief Bind a callback of the description
+    ///
+    /// @return false if the description has no callback of that name
+    ///
+    bool bind(std::string_view name, callback_type callback) {
+        auto id = m_def.callback_id(name);
+        if (id == machine_definition::npos) {
+            return false;
+        }
+
+        m_callbacks[id + 1] = std::move(callback);
+        return true;
+    }
+
+    ///
+    /// @brief Set the current state (the initial one by default) and call
+    /// its enter callback
+    ///
+    /// @return false if the state is out of range (the current state is
+    /// left unchanged)
+    ///
+    bool init() { return init(m_def.initial_state()); }
+
+    bool init(std::uint32_t state) {
+        if (state >= m_def.state_count()) {
+            return false;
+        }
+
+        m_state = state;
+        call(m_def.enter_callback(state), machine_definition::npos,
+             Payload{});
+        return true;
+    }
+
+    std::uint32_t index() const { return m_state; }
+
+    const machine_definition &definition() const { return m_def; }
+
+    ///
+    /// @brief Apply an input by id
+    ///
+    /// @return false if the input is rejected in the current state (or
+    /// out of range)
+    ///
+    bool transit(std::uint32_t input, const Payload &payload = Payload{}) {
+        if (input >= m_input_count) {
+            return false;
+        }
+
+        const auto &c = m_cells[m_state * m_input_count + input];
+        if (c.target == machine_definition::npos) {
+            return false;
+        }
+
+        if (c.target != m_state) {
+            call(m_def.exit_callback(m_state), input, payload);
+            m_state = c.target;
+            call(m_def.enter_callback(m_state), input, payload);
+        }
+        call(c.callback, input, payload);
+        return true;
+    }
+
+    ///
+    /// @brief Apply an input by name (name lookup on each call)
+    ///
+    bool transit(std::string_view input, const Payload &payload = Payload{}) {
+        return transit(m_def.input_id(input), payload);
+    }
+
+    ///
+    /// @brief Apply a sequence of input ids in order
+    ///
+    /// @return number of inputs applied, stops at the first rejected one
+    ///
+    std::size_t transit_range(const std::uint32_t *first,
+                              const std::uint32_t *last) {
+        std::size_t count = 0;
+        for (; first != last && transit(*first); ++first) {
+            ++count;
+        }
+        return count;
+    }
+
+   private:
+    void call(std::uint32_t callback, std::uint32_t input,
+              const Payload &payload) {
+        if (callback != 0 && m_callbacks[callback]) {
+            m_callbacks[callback](input, payload);
+        }
+    }
+
+    const machine_definition &m_def;
+    const machine_definition::cell *m_cells;
+    std::uint32_t m_input_count;
+    std::uint32_t m_state{0};
+    std::vector<callback_type> m_callbacks;
+};
+}  // namespace lsm
@@ -0,0 +1,536 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+///
+/// Fleet of state machines sharing one descriptor: only the compact
+/// state index of each machine is stored, machines are split into
+/// shards and batches of (machine id, input) are applied in parallel,
+/// one worker thread per shard.
+///
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+// fixed set of workers running the same job once per shard
+class shard_pool {
+   public:
+    using job_type = void (*)(void *, std::size_t);
+
+    explicit shard_pool(std::size_t shards) {
+        // the calling thread handles shard 0
+        for (std::size_t s = 1; s < shards; ++s) {
+            m_threads.emplace_back([this, s] { worker(s); });
+        }
+    }
+
+    shard_pool(const shard_pool &) = delete;
+    shard_pool &operator=(const shard_pool &) = delete;
+
+    ~shard_pool() {
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_quit = true;
+        }
+        m_wake.notify_all();
+
+        for (auto &t : m_threads) {
+            t.join();
+        }
+    }
+
+    void run(job_type job, void *ctx) {
+        if (!m_threads.empty()) {
+            {
+                std::lock_guard<std::mutex> lk{m_mutex};
+                m_job = job;
+                m_ctx = ctx;
+                m_pending = m_threads.size();
+                ++m_generation;
+            }
+            m_wake.notify_all();
+        }
+
+        job(ctx, 0);
+
+        if (!m_threads.empty()) {
+            std::unique_lock<std::mutex> lk{m_mutex};
+            m_done.wait(lk, [this] { return m_pending == 0; });
+        }
+    }
+
+   private:
+    void worker(std::size_t shard) {
+        std::size_t seen = 0;
+
+        for (;;) {
+            std::unique_lock<std::mutex> lk{m_mutex};
+            m_wake.wait(lk,
+                        [this, seen] { return m_quit || m_generation != seen; });
+
+            if (m_quit) {
+                return;
+            }
+
+            seen = m_generation;
+            auto job = m_job;
+            auto ctx = m_ctx;
+            lk.unlock();
+
+            job(ctx, shard);
+
+            lk.lock();
+            if (--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    job_type m_job{nullptr};
+    void *m_ctx{nullptr};
+    std::size_t m_pending{0};
+    std::size_t m_generation{0};
+    bool m_quit{false};
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Machine fleet
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Sharded set of state machines described by T
+///
+/// States are not stored: on_exit/on_enter are called on temporary
+/// state objects, so the fleet is suited to states without data.
+/// Transition callbacks and composite state hooks of different shards
+/// run concurrently on the shared descriptor and composite instances and
+/// must be thread safe.
+///
+template <typename T>
+class machine_fleet {
+   public:
+    using traits_type = traits::state_machine_traits<T>;
+    using table_type = typename traits_type::transition_table_type;
+    using state_types = typename traits_type::state_types;
+    using input_types = typename traits_type::input_types;
+    using state_index_type = typename traits_type::state_index_type;
+    using input_list_type = list::rebind_t<std::variant, input_types>;
+
+    machine_fleet(T &sm, std::size_t count,
+                  std::size_t shards = std::thread::hardware_concurrency())
+        : m_sm{sm},
+          m_count{count},
+          m_shard_count{std::max<std::size_t>(
+              1, std::min<std::size_t>(std::max<std::size_t>(shards, 1),
+                                       count))},
+          // at least 1, ids are divided by the shard size
+          m_shard_size{std::max<std::size_t>(
+              1, (count + m_shard_count - 1) / m_shard_count)},
+          m_shards(m_shard_count),
+          m_spans(m_shard_count + 1),
+          m_pool{m_shard_count} {
+        for (std::size_t s = 0; s < m_shard_count; ++s) {
+            auto first = s * m_shard_size;
+            auto last = std::min(count, first + m_shard_size);
+            m_shards[s].states.resize(last > first ? last - first : 0);
+        }
+    }
+
+    machine_fleet(const machine_fleet &) = delete;
+    machine_fleet &operator=(const machine_fleet &) = delete;
+
+    ///
+    /// @brief Set the state of every machine of the fleet, the composite
+    /// and leaf enter hooks are called once per machine
+    ///
+    template <typename State>
+    void init() {
+        using leaf = typename details::entry_path<State>::leaf;
+        constexpr auto idx = state_index<leaf>();
+        for (auto &shard : m_shards) {
+            std::fill(shard.states.begin(), shard.states.end(), idx);
+        }
+
+        for (std::size_t id = 0; id < m_count; ++id) {
+            enter<State>();
+        }
+    }
+
+    ///
+    /// @brief Set the state of one machine
+    ///
+    /// @return false if the id is out of range
+    ///
+    template <typename State>
+    bool init(std::size_t id) {
+        if (id >= m_count) {
+            return false;
+        }
+
+        slot(id) = state_index<typename details::entry_path<State>::leaf>();
+        enter<State>();
+        return true;
+    }
+
+    ///
+    /// @brief Apply one input to one machine from the calling thread
+    ///
+    /// @return false if the transition was rejected or the id is out of
+    /// range
+    ///
+    template <typename Input>
+    bool transit(std::size_t id, const Input &input) {
+        return id < m_count && apply(slot(id), input);
+    }
+
+    ///
+    /// @brief Apply a batch of (machine id, input) pairs in parallel
+    ///
+    /// The batch is split by shard first (each worker counts, then
+    /// scatters the events of a chunk of the batch), then each shard
+    /// worker applies the events of its machines in batch order. Events
+    /// are pair like types (first is the machine id, second an input or a
+    /// variant of inputs), events of ids out of range are rejected.
+    ///
+    template <typename Event>
+    void transit_batch(const Event *first, const Event *last) {
+        batch_context<Event> ctx{this, first, last};
+
+        if (m_shard_count == 1) {
+            apply_all(ctx);
+            return;
+        }
+
+        m_order.resize(static_cast<std::size_t>(last - first));
+        m_counts.assign(m_shard_count * count_stride(), 0);
+        m_pool.run(&count_chunk<Event>, &ctx);
+
+        // chunk counts to scatter offsets, shard spans are contiguous
+        std::size_t offset = 0;
+        for (std::size_t s = 0; s < m_shard_count; ++s) {
+            m_spans[s] = offset;
+            for (std::size_t c = 0; c < m_shard_count; ++c) {
+                auto &count = m_counts[c * count_stride() + s];
+                auto n = count;
+                count = offset;
+                offset += n;
+            }
+        }
+        m_spans[m_shard_count] = offset;
+
+        for (std::size_t c = 0; c < m_shard_count; ++c) {
+            m_out_of_range += m_counts[c * count_stride() + m_shard_count];
+        }
+
+        m_pool.run(&scatter_chunk<Event>, &ctx);
+        m_pool.run(&run_shard<Event>, &ctx);
+    }
+
+    template <typename Range>
+    void transit_batch(const Range &events) {
+        auto first = std::data(events);
+        transit_batch(first, first + std::size(events));
+    }
+
+    ///
+    /// @brief State index of a machine, the state count if the id is out
+    /// of range
+    ///
+    std::size_t index(std::size_t id) const {
+        return id < m_count ? slot(id) : list::size_v<state_types>;
+    }
+
+    ///
+    /// @brief Set the state index of a machine without calling hooks
+    /// (used to restore snapshots)
+    ///
+    /// @return false if the id or the index is out of range
+    ///
+    bool restore(std::size_t id, std::size_t index) {
+        if (id >= m_count || index >= list::size_v<state_types>) {
+            return false;
+        }
+
+        slot(id) = static_cast<state_index_type>(index);
+        return true;
+    }
+
+    template <typename State>
+    bool is(std::size_t id) const {
+        return id < m_count && slot(id) == state_index<State>();
+    }
+
+    ///
+    /// @brief Number of rejected inputs (ids out of range included), not
+    /// to be called during a batch
+    ///
+    std::size_t rejected() const {
+        std::size_t count = m_out_of_range;
+        for (const auto &shard : m_shards) {
+            count += shard.rejected;
+        }
+        return count;
+    }
+
+    std::size_t size() const { return m_count; }
+
+    std::size_t shard_count() const { return m_shard_count; }
+
+   private:
+    static constexpr std::size_t cache_line_size = 64;
+
+    struct alignas(cache_line_size) shard {
+        std::vector<state_index_type> states;
+        std::size_t rejected{0};
+    };
+
+    template <typename Event>
+    struct batch_context {
+        machine_fleet *self;
+        const Event *first;
+        const Event *last;
+    };
+
+    // per chunk counts of the events of each shard, then of the ids out
+    // of range, rows padded to cache lines
+    std::size_t count_stride() const {
+        constexpr auto per_line = cache_line_size / sizeof(std::size_t);
+        return (m_shard_count + per_line) / per_line * per_line;
+    }
+
+    // chunk of the batch partitioned by worker c
+    template <typename Event>
+    std::pair<std::size_t, std::size_t> chunk(
+        const batch_context<Event> &batch, std::size_t c) const {
+        auto size = static_cast<std::size_t>(batch.last - batch.first);
+        return {size * c / m_shard_count, size * (c + 1) / m_shard_count};
+    }
+
+    template <typename State>
+    void enter() {
+        using path = details::entry_path<State>;
+        enter_composites(typename path::composites{});
+        typename path::leaf state{};
+        details::enter_state(state);
+    }
+
+    template <typename State>
+    static constexpr state_index_type state_index() {
+        static_assert(list::has_v<State, state_types>,
+                      "state does not appear in the transition table");
+        return static_cast<state_index_type>(
+            list::index_of_v<State, state_types>);
+    }
+
+    state_index_type &slot(std::size_t id) {
+        return m_shards[id / m_shard_size].states[id % m_shard_size];
+    }
+
+    const state_index_type &slot(std::size_t id) const {
+        return m_shards[id / m_shard_size].states[id % m_shard_size];
+    }
+
+    template <typename State, typename Input>
+    static bool step(machine_fleet &self, state_index_type &idx,
+                     const Input &input) {
+        using candidates =
+            typename traits_type::template transitions_t<State, Input>;
+        return self.step_candidates<State>(idx, input, candidates{});
+    }
+
+    template <typename State, typename Input, typename... Txs>
+    bool step_candidates(state_index_type &idx, const Input &input,
+                         list::mplist<Txs...>) {
+        return (step_tx<State, Txs>(idx, input) || ...);
+    }
+
+    template <typename State, typename Tx, typename Input>
+    bool step_tx(state_index_type &idx, const Input &input) {
+        static_assert(!details::is_deferred_v<Tx>,
+                      "deferred inputs are not supported by machine_fleet");
+
+        using owner = details::owner_t<Tx, T>;
+
+        if constexpr (utilities::is_detected_v<details::guard_t, Tx, owner,
+                                               Input>) {
+            if (!Tx::guard(context<Tx>(), input)) {
+                return false;
+            }
+        }
+
+        using next_state = typename Tx::target_state_type;
+        using exits = utilities::detected_or_t<
+            list::mplist<>, details::exit_composites_t, Tx>;
+        using enters = utilities::detected_or_t<
+            list::mplist<>, details::enter_composites_t, Tx>;
+
+        if constexpr (!std::is_same_v<next_state, State> ||
+                      !list::is_empty_v<exits> || !list::is_empty_v<enters>) {
+            State state{};
+            details::exit_state(state);
+            exit_composites(exits{});
+            idx = state_index<next_state>();
+            enter_composites(enters{});
+            next_state next{};
+            details::enter_state(next);
+        }
+
+        Tx::apply(context<Tx>(), input);
+        return true;
+    }
+
+    // descriptor or composite state whose members are called by Tx
+    template <typename Tx>
+    auto &context() {
+        using owner = details::owner_t<Tx, T>;
+
+        if constexpr (std::is_same_v<owner, T>) {
+            return m_sm;
+        } else {
+            return m_composites.template get<owner>();
+        }
+    }
+
+    template <typename... Composites>
+    void exit_composites(list::mplist<Composites...>) {
+        (details::exit_state(m_composites.template get<Composites>()), ...);
+    }
+
+    template <typename... Composites>
+    void enter_composites(list::mplist<Composites...>) {
+        (details::enter_state(m_composites.template get<Composites>()), ...);
+    }
+
+    template <typename Input, typename... States>
+    static constexpr auto make_step_table(list::mplist<States...>) {
+        using step_type =
+            bool (*)(machine_fleet &, state_index_type &, const Input &);
+        return std::array<step_type, sizeof...(States)>{
+            &step<States, Input>...};
+    }
+
+    template <typename Input>
+    bool apply(state_index_type &idx, const Input &input) {
+        if constexpr (list::has_v<Input, input_types>) {
+            static constexpr auto table =
+                make_step_table<Input>(state_types{});
+            return table[idx](*this, idx, input);
+        } else if constexpr (std::is_same_v<Input, input_list_type>) {
+            return std::visit(
+                [this, &idx](const auto &arg) { return this->apply(idx, arg); },
+                input);
+        } else {
+            return false;
+        }
+    }
+
+    // single shard, applied in place from the calling thread
+    template <typename Event>
+    void apply_all(const batch_context<Event> &batch) {
+        auto &states = m_shards[0].states;
+        std::size_t rejected = 0;
+
+        for (auto e = batch.first; e != batch.last; ++e) {
+            const auto id = static_cast<std::size_t>(e->first);
+            if (id < m_count) {
+                rejected += !apply(states[id], e->second);
+            } else {
+                ++m_out_of_range;
+            }
+        }
+
+        m_shards[0].rejected += rejected;
+    }
+
+    template <typename Event>
+    static void count_chunk(void *ctx, std::size_t c) {
+        auto &batch = *static_cast<batch_context<Event> *>(ctx);
+        auto &self = *batch.self;
+        auto counts = &self.m_counts[c * self.count_stride()];
+        auto [first, last] = self.chunk(batch, c);
+
+        for (auto i = first; i != last; ++i) {
+            const auto id = static_cast<std::size_t>(batch.first[i].first);
+            ++counts[id < self.m_count ? id / self.m_shard_size
+                                       : self.m_shard_count];
+        }
+    }
+
+    template <typename Event>
+    static void scatter_chunk(void *ctx, std::size_t c) {
+        auto &batch = *static_cast<batch_context<Event> *>(ctx);
+        auto &self = *batch.self;
+        auto offsets = &self.m_counts[c * self.count_stride()];
+        auto [first, last] = self.chunk(batch, c);
+
+        for (auto i = first; i != last; ++i) {
+            const auto id = static_cast<std::size_t>(batch.first[i].first);
+            if (id < self.m_count) {
+                self.m_order[offsets[id / self.m_shard_size]++] = i;
+            }
+        }
+    }
+
+    template <typename Event>
+    static void run_shard(void *ctx, std::size_t s) {
+        auto &batch = *static_cast<batch_context<Event> *>(ctx);
+        auto &self = *batch.self;
+        auto &sh = self.m_shards[s];
+        const auto first_id = s * self.m_shard_size;
+        std::size_t rejected = 0;
+
+        for (auto i = self.m_spans[s]; i != self.m_spans[s + 1]; ++i) {
+            const auto &e = batch.first[self.m_order[i]];
+            const auto id = static_cast<std::size_t>(e.first);
+            rejected += !self.apply(sh.states[id - first_id], e.second);
+        }
+
+        sh.rejected += rejected;
+    }
+
+    T &m_sm;
+    details::composite_set<typename traits_type::composite_types> m_composites;
+    std::size_t m_count;
+    std::size_t m_shard_count;
+    std::size_t m_shard_size;
+    std::vector<shard> m_shards;
+    // batch partition: positions of the events grouped by shard
+    std::vector<std::size_t> m_order;
+    std::vector<std::size_t> m_counts;
+    std::vector<std::size_t> m_spans;
+    std::size_t m_out_of_range{0};
+    details::shard_pool m_pool;
+};
+}  // namespace lsm
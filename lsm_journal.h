@@ -0,0 +1,574 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+///
+/// Input journal for lsm state machines: the inputs applied with transit
+/// are appended as (timestamp, input index, payload) records to a
+/// segmented log of preallocated memory mapped files, synced in batches,
+/// and can be replayed into fresh machines with or without callbacks.
+///
+/// Layout of a segment file <path>.<segment number> (native byte order):
+///   segment header | records | zeros up to the segment size
+/// Layout of a record, aligned on 8 bytes:
+///   timestamp (uint64) | input index + 1 (uint32) | payload size (uint32) |
+///   payload
+/// The top bit of the input field flags a nested input, i.e. applied from
+/// a transition callback of the machine.
+///
+/// The payload of an input is its object representation if it is
+/// trivially copyable, an input can define its own encoding with:
+///   static constexpr std::size_t serialized_size;
+///   void serialize(std::byte *out) const;
+///   void deserialize(const std::byte *in);
+///
+
+//--------------------------------------------------------
+// Format
+//--------------------------------------------------------
+
+namespace lsm {
+struct journal_segment_header {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t table_hash;
+    std::uint64_t segment;
+    std::uint64_t reserved;
+};
+
+struct journal_record_header {
+    std::uint64_t timestamp;
+    std::uint32_t input;  // null at the end of a segment
+    std::uint32_t size;
+
+    static constexpr std::uint32_t nested = std::uint32_t{1} << 31;
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm {
+template <typename T>
+class journal_reader;
+}  // namespace lsm
+
+namespace lsm::details {
+template <typename Input>
+using journal_serialized_size_t = decltype(Input::serialized_size);
+
+template <typename Input>
+constexpr std::size_t journal_payload_size() {
+    if constexpr (utilities::is_detected_v<journal_serialized_size_t,
+                                           Input>) {
+        return Input::serialized_size;
+    } else if constexpr (std::is_empty_v<Input>) {
+        return 0;
+    } else {
+        static_assert(std::is_trivially_copyable_v<Input>,
+                      "journaled input must be trivially copyable or define "
+                      "serialized_size, serialize and deserialize");
+        return sizeof(Input);
+    }
+}
+
+template <typename Input>
+void write_journal_payload(std::byte *out, const Input &input) {
+    if constexpr (utilities::is_detected_v<journal_serialized_size_t,
+                                           Input>) {
+        input.serialize(out);
+    } else if constexpr (!std::is_empty_v<Input>) {
+        std::memcpy(out, &input, sizeof(input));
+    }
+}
+
+// calls f(timestamp, input), payloads are read in place when aligned
+template <typename Input, typename F>
+void read_journal_payload(const std::byte *in, std::uint64_t timestamp,
+                          F &f) {
+    if constexpr (utilities::is_detected_v<journal_serialized_size_t,
+                                           Input>) {
+        Input input{};
+        input.deserialize(in);
+        f(timestamp, static_cast<const Input &>(input));
+    } else if constexpr (std::is_empty_v<Input>) {
+        f(timestamp, Input{});
+    } else if (reinterpret_cast<std::uintptr_t>(in) % alignof(Input) == 0) {
+        f(timestamp, *reinterpret_cast<const Input *>(in));
+    } else {
+        Input input;
+        std::memcpy(&input, in, sizeof(input));
+        f(timestamp, static_cast<const Input &>(input));
+    }
+}
+
+template <typename Inputs>
+struct journal_format {
+    static constexpr std::uint32_t magic = 0x4a4d534c;  // "LSMJ"
+    static constexpr std::uint32_t version = 3;
+
+    // compiler independent: structure of the (flattened) table, then size,
+    // alignment and payload size of each input in index order
+    template <typename Table>
+    static constexpr std::uint64_t table_hash() {
+        return input_hash(table_structure<Table>::hash(), Inputs{});
+    }
+
+    static constexpr std::size_t record_size(std::size_t payload_size) {
+        return (sizeof(journal_record_header) + payload_size + 7) &
+               ~std::size_t{7};
+    }
+
+    template <typename... Is>
+    static constexpr std::uint64_t input_hash(std::uint64_t hash,
+                                              lsm::list::mplist<Is...>) {
+        ((hash = utilities::fnv1a(
+              utilities::fnv1a(utilities::fnv1a(hash, sizeof(Is)),
+                               alignof(Is)),
+              journal_payload_size<Is>())),
+         ...);
+        return hash;
+    }
+
+    static std::string segment_path(const std::string &path,
+                                    std::size_t segment) {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%06zu", segment);
+        return path + suffix;
+    }
+};
+
+// single writer of the segments of a log
+template <typename Inputs>
+class journal_writer {
+   public:
+    using format_type = journal_format<Inputs>;
+
+    journal_writer(std::string path, std::uint64_t table_hash,
+                   std::size_t segment_size, std::size_t sync_bytes)
+        : m_path{std::move(path)},
+          m_table_hash{table_hash},
+          m_segment_size{segment_size & ~std::size_t{7}},
+          m_sync_bytes{sync_bytes} {
+        // new records go to a new segment after the existing ones
+        struct stat st;
+        while (::stat(format_type::segment_path(m_path, m_segment).c_str(),
+                      &st) == 0) {
+            ++m_segment;
+        }
+        open_segment();
+    }
+
+    journal_writer(const journal_writer &) = delete;
+    journal_writer &operator=(const journal_writer &) = delete;
+
+    ~journal_writer() { close_segment(); }
+
+    bool is_open() const { return m_data != nullptr; }
+
+    template <typename Input>
+    bool append(std::uint64_t timestamp, const Input &input, bool nested) {
+        constexpr auto payload = journal_payload_size<Input>();
+        constexpr auto size = format_type::record_size(payload);
+
+        if (m_offset + size > m_size) {
+            close_segment();
+            ++m_segment;
+            if (!open_segment() || m_offset + size > m_size) {
+                return false;
+            }
+        }
+
+        // header last, a record is complete once its input is set
+        auto out = m_data + m_offset;
+        write_journal_payload(out + sizeof(journal_record_header), input);
+        auto index =
+            static_cast<std::uint32_t>(list::index_of_v<Input, Inputs> + 1);
+        journal_record_header header{
+            timestamp, nested ? index | journal_record_header::nested : index,
+            static_cast<std::uint32_t>(payload)};
+        std::memcpy(out, &header, sizeof(header));
+        m_offset += size;
+
+        if (m_offset - m_synced >= m_sync_bytes) {
+            sync(MS_ASYNC);
+        }
+        return true;
+    }
+
+    void flush() {
+        if (m_data != nullptr) {
+            sync(MS_SYNC);
+        }
+    }
+
+    std::size_t segment() const { return m_segment; }
+
+   private:
+    bool open_segment() {
+        auto file = format_type::segment_path(m_path, m_segment);
+        int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        // blocks are allocated up front, appends never extend the file
+#if defined(__APPLE__)
+        bool allocated = ::ftruncate(fd, m_segment_size) == 0;
+#else
+        bool allocated = ::posix_fallocate(fd, 0, m_segment_size) == 0;
+#endif
+        void *addr = allocated ? ::mmap(nullptr, m_segment_size,
+                                        PROT_READ | PROT_WRITE, MAP_SHARED,
+                                        fd, 0)
+                               : MAP_FAILED;
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            ::unlink(file.c_str());
+            return false;
+        }
+
+        m_data = static_cast<std::byte *>(addr);
+        m_size = m_segment_size;
+        journal_segment_header header{format_type::magic,
+                                      format_type::version,
+                                      m_table_hash, m_segment, 0};
+        std::memcpy(m_data, &header, sizeof(header));
+        m_offset = sizeof(header);
+        m_synced = 0;
+        return true;
+    }
+
+    void close_segment() {
+        if (m_data != nullptr) {
+            sync(MS_SYNC);
+            ::munmap(m_data, m_size);
+            m_data = nullptr;
+            m_size = 0;
+            m_offset = 0;
+        }
+    }
+
+    // pages written since the last sync
+    void sync(int flags) {
+        static const std::size_t page = ::sysconf(_SC_PAGESIZE);
+        auto first = m_synced & ~(page - 1);
+        ::msync(m_data + first, m_offset - first, flags);
+        m_synced = m_offset;
+    }
+
+    std::string m_path;
+    std::uint64_t m_table_hash;
+    std::size_t m_segment_size;
+    std::size_t m_sync_bytes;
+    std::size_t m_segment{0};
+    std::byte *m_data{nullptr};
+    std::size_t m_size{0};
+    std::size_t m_offset{0};
+    std::size_t m_synced{0};
+};
+
+// journal of the journaled policy, one per machine
+template <typename Inputs, typename Clock>
+class journal_recorder {
+   public:
+    using writer_type = journal_writer<Inputs>;
+
+    ///
+    /// @brief Record the inputs to log (nullptr to stop recording)
+    ///
+    void attach(writer_type *log) { m_log = log; }
+
+    ///
+    /// @brief Number of inputs that could not be recorded
+    ///
+    std::size_t dropped() const { return m_dropped; }
+
+    template <typename Input>
+    void record(std::size_t, const Input &input) {
+        if constexpr (lsm::list::has_v<Input, Inputs>) {
+            if (m_log != nullptr && !m_replaying) {
+                auto timestamp =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now().time_since_epoch())
+                        .count();
+                if (!m_log->append(static_cast<std::uint64_t>(timestamp),
+                                   input, m_depth != 0)) {
+                    ++m_dropped;
+                }
+            }
+        }
+    }
+
+    void enter() { ++m_depth; }
+
+    void leave() { --m_depth; }
+
+    bool callbacks() const { return m_callbacks; }
+
+   private:
+    template <typename>
+    friend class lsm::journal_reader;
+
+    writer_type *m_log{nullptr};
+    std::size_t m_dropped{0};
+    std::size_t m_depth{0};
+    bool m_replaying{false};
+    bool m_callbacks{true};
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Policies
+//--------------------------------------------------------
+
+namespace lsm::policies {
+///
+/// @brief Record the inputs applied with transit, timestamped with Clock
+/// (see state_machine_front::journal and journal_log)
+///
+/// Inputs applied from transition callbacks are recorded as nested, on
+/// replay they are applied again by the callbacks, or from the journal if
+/// callbacks are not called.
+///
+template <typename Clock>
+struct basic_journaled {
+    template <typename Inputs>
+    using journal = details::journal_recorder<Inputs, Clock>;
+};
+
+using journaled = basic_journaled<std::chrono::system_clock>;
+}  // namespace lsm::policies
+
+//--------------------------------------------------------
+// Journal log and replay
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Segmented log of the inputs of machines described by T
+///
+/// Segments of segment_size bytes are preallocated and memory mapped, the
+/// pages written are synced asynchronously every sync_bytes and
+/// synchronously by flush and when a segment is closed. A log opened on
+/// an existing path appends new segments after the existing ones.
+///
+template <typename T>
+class journal_log : public details::journal_writer<
+                        typename traits::state_machine_traits<T>::input_types> {
+    using traits_type = traits::state_machine_traits<T>;
+    using writer_type =
+        details::journal_writer<typename traits_type::input_types>;
+
+   public:
+    explicit journal_log(std::string path,
+                         std::size_t segment_size = std::size_t{64} << 20,
+                         std::size_t sync_bytes = std::size_t{1} << 20)
+        : writer_type{std::move(path),
+                      writer_type::format_type::template table_hash<
+                          typename traits_type::transition_table_type>(),
+                      segment_size, sync_bytes} {}
+};
+
+///
+/// @brief Read the segments of a journal log in order
+///
+template <typename T>
+class journal_reader {
+   public:
+    using input_types = typename traits::state_machine_traits<T>::input_types;
+    using format_type = details::journal_format<input_types>;
+
+    explicit journal_reader(std::string path) : m_path{std::move(path)} {}
+
+    ///
+    /// @brief Call f(timestamp, input) for each record, nested inputs
+    /// (applied from transition callbacks) are skipped unless nested is
+    /// true
+    ///
+    /// @return number of records read, reading stops at the first segment
+    /// missing, or not written for T (valid() is then false)
+    ///
+    template <typename F>
+    std::size_t for_each(F &&f, bool nested = false) {
+        std::size_t count = 0;
+        m_valid = true;
+
+        for (std::size_t segment = 0;; ++segment) {
+            auto file = format_type::segment_path(m_path, segment);
+            int fd = ::open(file.c_str(), O_RDONLY);
+            if (fd < 0) {
+                break;
+            }
+
+            struct stat st;
+            void *addr = MAP_FAILED;
+            std::size_t size = 0;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                size = static_cast<std::size_t>(st.st_size);
+                addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+
+            if (addr == MAP_FAILED) {
+                m_valid = false;
+                break;
+            }
+
+            ::madvise(addr, size, MADV_SEQUENTIAL);
+            bool read = read_segment(static_cast<const std::byte *>(addr),
+                                     size, segment, nested, f, count);
+            ::munmap(addr, size);
+
+            if (!read) {
+                m_valid = false;
+                break;
+            }
+        }
+        return count;
+    }
+
+    ///
+    /// @brief Apply the records to a machine with transit
+    ///
+    /// With callbacks false, transition callbacks and state hooks are not
+    /// called (guards still are) and state data is not rebuilt, the
+    /// nested inputs recorded are applied in their place.
+    ///
+    /// @return number of records replayed
+    ///
+    std::size_t replay(state_machine_front<T> &front, bool callbacks = false) {
+        replay_scope scope{front.journal(), callbacks};
+        return for_each(
+            [&front](std::uint64_t, const auto &input) {
+                front.transit(input);
+            },
+            !callbacks);
+    }
+
+    ///
+    /// @brief False if the last read stopped on a segment that is not
+    /// part of a journal of T
+    ///
+    bool valid() const { return m_valid; }
+
+   private:
+    using journal_type = typename state_machine_front<T>::journal_type;
+
+    static_assert(!std::is_same_v<journal_type, details::no_journal>,
+                  "journal replay requires a journal policy");
+
+    // replaying inputs are not recorded again
+    struct replay_scope {
+        replay_scope(journal_type &journal, bool callbacks)
+            : m_journal{journal} {
+            m_journal.m_replaying = true;
+            m_journal.m_callbacks = callbacks;
+        }
+
+        ~replay_scope() {
+            m_journal.m_replaying = false;
+            m_journal.m_callbacks = true;
+        }
+
+        journal_type &m_journal;
+    };
+
+    template <typename F>
+    using reader_type = void (*)(const std::byte *, std::uint64_t, F &);
+
+    template <typename F, typename... Inputs>
+    static constexpr auto make_reader_table(list::mplist<Inputs...>) {
+        return std::array<reader_type<F>, sizeof...(Inputs)>{
+            &details::read_journal_payload<Inputs, F>...};
+    }
+
+    template <typename... Inputs>
+    static constexpr auto make_size_table(list::mplist<Inputs...>) {
+        return std::array<std::size_t, sizeof...(Inputs)>{
+            details::journal_payload_size<Inputs>()...};
+    }
+
+    template <typename F>
+    static bool read_segment(const std::byte *data, std::size_t size,
+                             std::size_t segment, bool nested, F &f,
+                             std::size_t &count) {
+        static constexpr auto readers = make_reader_table<F>(input_types{});
+        static constexpr auto sizes = make_size_table(input_types{});
+        constexpr auto table_hash = format_type::template table_hash<
+            typename traits::state_machine_traits<T>::transition_table_type>();
+
+        journal_segment_header segment_header;
+        if (size < sizeof(segment_header)) {
+            return false;
+        }
+        std::memcpy(&segment_header, data, sizeof(segment_header));
+        if (segment_header.magic != format_type::magic ||
+            segment_header.version != format_type::version ||
+            segment_header.table_hash != table_hash ||
+            segment_header.segment != segment) {
+            return false;
+        }
+
+        std::size_t offset = sizeof(segment_header);
+        journal_record_header header;
+        while (offset + sizeof(header) <= size) {
+            std::memcpy(&header, data + offset, sizeof(header));
+            if (header.input == 0) {
+                break;
+            }
+
+            auto input = (header.input & ~journal_record_header::nested) - 1;
+            auto record = format_type::record_size(header.size);
+            if (input >= readers.size() || header.size != sizes[input] ||
+                offset + record > size) {
+                return false;
+            }
+
+            if (nested || (header.input & journal_record_header::nested) == 0) {
+                readers[input](data + offset + sizeof(header),
+                               header.timestamp, f);
+                ++count;
+            }
+            offset += record;
+        }
+        return true;
+    }
+
+    std::string m_path;
+    bool m_valid{true};
+};
+}  // namespace lsm
+#endif
@@ -0,0 +1,471 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LSM_LEXER_SIMD 1
+#endif
+
+///
+/// Lexer mode for lsm state machines: inputs are classes of bytes and the
+/// transition table is compiled into a dense next-state array indexed by
+/// (state, byte), run over a byte buffer in a tight loop. Runs of plain
+/// self transitions are skipped (with SSE2/AVX2 range scans when the bytes
+/// of the run form at most 4 ranges), state hooks and transition
+/// callbacks are called at token boundaries only.
+///
+/// An input is a byte class defining:
+///   static constexpr bool contains(unsigned char c);
+/// (see byte_set, byte_range and byte_union), a byte belongs to the first
+/// class of the table that contains it.
+///
+
+//--------------------------------------------------------
+// Byte classes
+//--------------------------------------------------------
+
+namespace lsm {
+template <unsigned char... Bytes>
+struct byte_set {
+    static constexpr bool contains(unsigned char c) {
+        return ((c == Bytes) || ...);
+    }
+};
+
+template <unsigned char First, unsigned char Last>
+struct byte_range {
+    static constexpr bool contains(unsigned char c) {
+        return c >= First && c <= Last;
+    }
+};
+
+template <typename... Classes>
+struct byte_union {
+    static constexpr bool contains(unsigned char c) {
+        return (Classes::contains(c) || ...);
+    }
+};
+
+struct any_byte {
+    static constexpr bool contains(unsigned char) { return true; }
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+template <typename Input>
+using byte_class_t = decltype(Input::contains(static_cast<unsigned char>(0)));
+
+// index of the first class containing c, the number of classes if none
+template <typename... Inputs>
+constexpr std::size_t byte_class_of(unsigned char c,
+                                    lsm::list::mplist<Inputs...>) {
+    std::size_t idx = 0;
+    bool found = false;
+    ((found = found || Inputs::contains(c), idx += !found), ...);
+    return idx;
+}
+
+// bytes of a self transition run, as ranges for the SIMD scan
+struct byte_ranges {
+    static constexpr std::size_t max_count = 4;
+
+    std::size_t count{0};
+    std::array<unsigned char, max_count> first{};
+    std::array<unsigned char, max_count> last{};
+};
+
+inline const unsigned char *skip_ranges(const byte_ranges &ranges,
+                                        const unsigned char *p,
+                                        const unsigned char *end) {
+#if defined(LSM_LEXER_SIMD)
+    // c in [first, last] <=> unsigned (c - first) <= (last - first)
+#if defined(__AVX2__)
+    __m256i wide_lo[byte_ranges::max_count];
+    __m256i wide_width[byte_ranges::max_count];
+    for (std::size_t r = 0; r < ranges.count; ++r) {
+        wide_lo[r] = _mm256_set1_epi8(static_cast<char>(ranges.first[r]));
+        wide_width[r] = _mm256_set1_epi8(
+            static_cast<char>(ranges.last[r] - ranges.first[r]));
+    }
+
+    while (end - p >= 32) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto in = _mm256_setzero_si256();
+        for (std::size_t r = 0; r < ranges.count; ++r) {
+            auto d = _mm256_sub_epi8(x, wide_lo[r]);
+            in = _mm256_or_si256(
+                in, _mm256_cmpeq_epi8(_mm256_max_epu8(d, wide_width[r]),
+                                      wide_width[r]));
+        }
+
+        auto out = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(in));
+        if (out != 0) {
+            return p + __builtin_ctz(out);
+        }
+        p += 32;
+    }
+#endif
+    __m128i lo[byte_ranges::max_count];
+    __m128i width[byte_ranges::max_count];
+    for (std::size_t r = 0; r < ranges.count; ++r) {
+        lo[r] = _mm_set1_epi8(static_cast<char>(ranges.first[r]));
+        width[r] =
+            _mm_set1_epi8(static_cast<char>(ranges.last[r] - ranges.first[r]));
+    }
+
+    while (end - p >= 16) {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto in = _mm_setzero_si128();
+        for (std::size_t r = 0; r < ranges.count; ++r) {
+            auto d = _mm_sub_epi8(x, lo[r]);
+            in = _mm_or_si128(
+                in, _mm_cmpeq_epi8(_mm_max_epu8(d, width[r]), width[r]));
+        }
+
+        auto out = ~static_cast<std::uint32_t>(_mm_movemask_epi8(in)) & 0xffff;
+        if (out != 0) {
+            return p + __builtin_ctz(out);
+        }
+        p += 16;
+    }
+#else
+    (void)ranges;
+    (void)end;
+#endif
+    return p;
+}
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Lexer
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Run the machine described by T over byte buffers
+///
+/// Transition callbacks receive a default constructed byte class, the
+/// bytes of the token that ends (from the entry in the source state up to
+/// the current byte) are given by token(). Self transitions with a
+/// callback are supported but called for each byte. Guards, deferred
+/// inputs and composite states are not supported.
+///
+template <typename T>
+class lexer {
+   public:
+    using traits_type = traits::state_machine_traits<T>;
+    using state_types = typename traits_type::state_types;
+    using input_types = typename traits_type::input_types;
+    using state_index_type = typename traits_type::state_index_type;
+
+    static_assert(list::is_empty_v<typename traits_type::composite_types>,
+                  "composite states are not supported by lexer");
+
+    explicit lexer(T &sm) : m_sm{sm} {}
+
+    lexer(const lexer &) = delete;
+    lexer &operator=(const lexer &) = delete;
+
+    template <typename State>
+    void init() {
+        m_state = state_index<State>();
+        details::enter_state(m_states.template get<State>());
+    }
+
+    ///
+    /// @brief Apply the bytes of text in order
+    ///
+    /// @return bytes consumed, the byte at this offset (if any) was
+    /// rejected and the machine is left in the state that rejected it
+    ///
+    std::size_t run(std::string_view text) {
+        static constexpr auto byte_classes = make_byte_classes();
+        static constexpr auto next_table =
+            make_next_table(byte_classes, state_types{});
+        static constexpr auto action_table = make_action_table(state_types{});
+        static constexpr auto skip_table = make_skip_table(next_table);
+
+        auto first = reinterpret_cast<const unsigned char *>(text.data());
+        auto last = first + text.size();
+        auto p = first;
+        std::size_t state = m_state;
+
+        // a token started in a previous buffer starts at the buffer start
+        m_token = first;
+
+        while (p != last) {
+            const auto *row = &next_table[state * byte_count];
+
+            // short runs are cheaper byte per byte, long runs are scanned
+            auto scalar_end = last - p > scan_after ? p + scan_after : last;
+            while (p != scalar_end && row[*p] == state) {
+                ++p;
+            }
+            if (p == scalar_end && p != last) {
+                p = details::skip_ranges(skip_table[state], p, last);
+                while (p != last && row[*p] == state) {
+                    ++p;
+                }
+            }
+            if (p == last) {
+                break;
+            }
+
+            auto next = row[*p];
+            if (next == rejected) {
+                break;
+            }
+
+            // token boundary (or self transition with a callback)
+            m_pos = p;
+            m_state = static_cast<state_index_type>(state);
+            if (auto action =
+                    action_table[state * class_count + byte_classes[*p]]) {
+                action(*this);
+            }
+            if (next != self_callback) {
+                state = next;
+                m_token = p;
+            }
+            ++p;
+        }
+
+        m_state = static_cast<state_index_type>(state);
+        m_pos = p;
+        return static_cast<std::size_t>(p - first);
+    }
+
+    ///
+    /// @brief Bytes of the current token, valid during run
+    ///
+    std::string_view token() const {
+        return {reinterpret_cast<const char *>(m_token),
+                static_cast<std::size_t>(m_pos - m_token)};
+    }
+
+    std::size_t index() const { return m_state; }
+
+    template <typename State>
+    bool is() const {
+        return m_state == state_index<State>();
+    }
+
+   private:
+    static constexpr std::size_t byte_count = 256;
+    static constexpr std::ptrdiff_t scan_after = 16;
+    static constexpr std::size_t state_count = list::size_v<state_types>;
+    static constexpr std::size_t class_count = list::size_v<input_types>;
+
+    // next state entries, a plain self transition keeps the state index
+    using next_type = utilities::smallest_uint_t<state_count + 1>;
+    static constexpr next_type rejected = state_count;
+    static constexpr next_type self_callback = state_count + 1;
+
+    using action_type = void (*)(lexer &);
+
+    template <typename State>
+    static constexpr state_index_type state_index() {
+        static_assert(list::has_v<State, state_types>,
+                      "state does not appear in the transition table");
+        return static_cast<state_index_type>(
+            list::index_of_v<State, state_types>);
+    }
+
+    template <typename State, typename Input>
+    static constexpr next_type target() {
+        static_assert(
+            utilities::is_detected_v<details::byte_class_t, Input>,
+            "lexer inputs must be byte classes (static bool contains)");
+
+        using tx = typename traits_type::template transition_t<State, Input>;
+
+        if constexpr (std::is_same_v<tx, utilities::nonsuch>) {
+            return rejected;
+        } else {
+            static_assert(!utilities::is_detected_v<details::guard_t, tx, T,
+                                                    Input> &&
+                              !details::is_deferred_v<tx>,
+                          "guards and deferred inputs are not supported by "
+                          "lexer");
+
+            using next_state = typename tx::target_state_type;
+            if constexpr (!std::is_same_v<next_state, State>) {
+                return state_index<next_state>();
+            } else if constexpr (std::is_same_v<
+                                     tx, typename T::template transition<
+                                             State, Input, State>>) {
+                return state_index<State>();
+            } else {
+                return self_callback;
+            }
+        }
+    }
+
+    template <typename State>
+    static constexpr bool has_hooks() {
+        bool hooks = false;
+        if constexpr (utilities::is_detected_v<details::on_enter_t, State>) {
+            hooks = hooks || !std::is_same_v<decltype(&State::on_enter),
+                                             decltype(&base_state::on_enter)>;
+        }
+        if constexpr (utilities::is_detected_v<details::on_exit_t, State>) {
+            hooks = hooks || !std::is_same_v<decltype(&State::on_exit),
+                                             decltype(&base_state::on_exit)>;
+        }
+        return hooks;
+    }
+
+    // plain transitions between states without hooks need no action
+    template <typename State, typename Input>
+    static constexpr action_type action() {
+        using tx = typename traits_type::template transition_t<State, Input>;
+
+        if constexpr (std::is_same_v<tx, utilities::nonsuch>) {
+            return nullptr;
+        } else {
+            using next_state = typename tx::target_state_type;
+            if constexpr (std::is_same_v<tx, typename T::template transition<
+                                                 State, Input, next_state>> &&
+                          !has_hooks<State>() && !has_hooks<next_state>()) {
+                return nullptr;
+            } else {
+                return &step<State, Input>;
+            }
+        }
+    }
+
+    template <typename State, typename Input>
+    static void step(lexer &self) {
+        using tx = typename traits_type::template transition_t<State, Input>;
+
+        if constexpr (!std::is_same_v<tx, utilities::nonsuch>) {
+            using next_state = typename tx::target_state_type;
+
+            if constexpr (!std::is_same_v<next_state, State>) {
+                details::exit_state(self.m_states.template get<State>());
+                self.m_state = state_index<next_state>();
+                details::enter_state(self.m_states.template get<next_state>());
+            }
+
+            tx::apply(self.m_sm, Input{});
+        }
+    }
+
+    static constexpr auto make_byte_classes() {
+        std::array<std::uint8_t, byte_count> classes{};
+        static_assert(class_count < UINT8_MAX, "too many byte classes");
+
+        for (std::size_t c = 0; c < byte_count; ++c) {
+            classes[c] = static_cast<std::uint8_t>(details::byte_class_of(
+                static_cast<unsigned char>(c), input_types{}));
+        }
+        return classes;
+    }
+
+    template <typename State, typename... Inputs>
+    static constexpr auto make_targets(list::mplist<Inputs...>) {
+        // one more entry for the bytes of no class
+        return std::array<next_type, class_count + 1>{
+            target<State, Inputs>()..., rejected};
+    }
+
+    template <typename Classes, typename... States>
+    static constexpr auto make_next_table(const Classes &byte_classes,
+                                          list::mplist<States...>) {
+        constexpr std::array<std::array<next_type, class_count + 1>,
+                             state_count>
+            targets{make_targets<States>(input_types{})...};
+
+        std::array<next_type, state_count * byte_count> table{};
+        for (std::size_t s = 0; s < state_count; ++s) {
+            for (std::size_t c = 0; c < byte_count; ++c) {
+                table[s * byte_count + c] = targets[s][byte_classes[c]];
+            }
+        }
+        return table;
+    }
+
+    template <typename State, typename... Inputs>
+    static constexpr auto make_actions(list::mplist<Inputs...>) {
+        return std::array<action_type, class_count>{action<State, Inputs>()...};
+    }
+
+    template <typename... States>
+    static constexpr auto make_action_table(list::mplist<States...>) {
+        constexpr std::array<std::array<action_type, class_count>,
+                             state_count>
+            rows{make_actions<States>(input_types{})...};
+
+        std::array<action_type, state_count * class_count> table{};
+        for (std::size_t s = 0; s < state_count; ++s) {
+            for (std::size_t i = 0; i < class_count; ++i) {
+                table[s * class_count + i] = rows[s][i];
+            }
+        }
+        return table;
+    }
+
+    // runs of at most byte_ranges::max_count ranges are scanned
+    template <typename NextTable>
+    static constexpr auto make_skip_table(const NextTable &next_table) {
+        std::array<details::byte_ranges, state_count> table{};
+
+        for (std::size_t s = 0; s < state_count; ++s) {
+            details::byte_ranges ranges;
+            std::size_t count = 0;
+
+            for (std::size_t c = 0; c < byte_count; ++c) {
+                bool in = next_table[s * byte_count + c] == s;
+                bool prev_in =
+                    c != 0 && next_table[s * byte_count + c - 1] == s;
+
+                if (in && !prev_in) {
+                    if (count < details::byte_ranges::max_count) {
+                        ranges.first[count] = static_cast<unsigned char>(c);
+                    }
+                    ++count;
+                }
+                if (in && count <= details::byte_ranges::max_count) {
+                    ranges.last[count - 1] = static_cast<unsigned char>(c);
+                }
+            }
+
+            ranges.count =
+                count <= details::byte_ranges::max_count ? count : 0;
+            table[s] = ranges;
+        }
+        return table;
+    }
+
+    T &m_sm;
+    details::composite_set<state_types> m_states;
+    state_index_type m_state{0};
+    const unsigned char *m_token{nullptr};
+    const unsigned char *m_pos{nullptr};
+};
+}  // namespace lsm
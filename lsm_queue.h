@@ -0,0 +1,239 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <variant>
+
+///
+/// Queued front-end for lsm state machines: any number of producer
+/// threads post inputs into a bounded lock-free ring buffer that
+/// a single consumer drains into state_machine_front::transit.
+///
+
+//--------------------------------------------------------
+// Policies
+//--------------------------------------------------------
+
+namespace lsm::policies {
+///
+/// @brief Producers spin (yielding) until a slot is available
+///
+struct block_when_full {};
+
+///
+/// @brief Inputs posted to a full queue are discarded and counted
+///
+struct drop_when_full {};
+
+///
+/// @brief Posting to a full queue fails and the producer decides
+///
+struct report_when_full {};
+}  // namespace lsm::policies
+
+//--------------------------------------------------------
+// Queued state machine
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Bounded MPSC input queue in front of a state machine
+///
+/// Inputs are stored by value in a variant of all the input types of the
+/// transition table so posting never allocates. The consumer side (drain,
+/// or the thread launched by start) must be used by one thread at a time.
+///
+template <typename T, std::size_t Capacity = 1024,
+          typename FullPolicy = policies::report_when_full>
+class queued_machine {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "queue capacity must be a power of two");
+
+   public:
+    using front_type = state_machine_front<T>;
+    using input_types = typename front_type::input_types;
+    using input_list_type = list::rebind_t<
+        std::variant, list::push_front_t<std::monostate, input_types>>;
+
+    explicit queued_machine(front_type &front)
+        : m_front{front}, m_cells{std::make_unique<cell[]>(Capacity)} {
+        for (std::size_t i = 0; i < Capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    queued_machine(const queued_machine &) = delete;
+    queued_machine &operator=(const queued_machine &) = delete;
+
+    ~queued_machine() { stop(); }
+
+    ///
+    /// @brief Post an input, thread safe
+    ///
+    /// @return false if the input was not queued (full queue with
+    /// drop_when_full or report_when_full policy)
+    ///
+    template <typename Input>
+    bool post(Input &&input) {
+        static_assert(list::has_v<std::decay_t<Input>, input_types>,
+                      "input type does not appear in the transition table");
+
+        if constexpr (std::is_same_v<FullPolicy, policies::block_when_full>) {
+            // an input is only stored (and moved) once a slot is claimed
+            while (!try_post(std::forward<Input>(input))) {
+                std::this_thread::yield();
+            }
+            return true;
+        } else if constexpr (std::is_same_v<FullPolicy,
+                                            policies::drop_when_full>) {
+            if (!try_post(std::forward<Input>(input))) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        } else {
+            return try_post(std::forward<Input>(input));
+        }
+    }
+
+    ///
+    /// @brief Apply up to max queued inputs, consumer side only
+    ///
+    /// @return number of inputs applied
+    ///
+    std::size_t drain(std::size_t max = Capacity) {
+        std::size_t count = 0;
+        while (count < max && pop_apply()) {
+            ++count;
+        }
+        return count;
+    }
+
+    ///
+    /// @brief Launch a consumer thread draining the queue until stop
+    ///
+    /// The machine error handler must not throw when the queue is drained
+    /// by this thread.
+    ///
+    void start() {
+        if (m_running.exchange(true)) {
+            return;
+        }
+
+        m_consumer = std::thread([this] {
+            while (m_running.load(std::memory_order_acquire)) {
+                if (drain() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+            // apply what was posted before stop
+            while (drain() != 0) {
+            }
+        });
+    }
+
+    void stop() {
+        if (m_running.exchange(false) && m_consumer.joinable()) {
+            m_consumer.join();
+        }
+    }
+
+    std::size_t dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    static constexpr std::size_t capacity() { return Capacity; }
+
+   private:
+    static constexpr std::size_t cache_line_size = 64;
+    static constexpr std::size_t mask = Capacity - 1;
+
+    // slot of the ring, seq tells which lap of the ring owns it
+    struct alignas(cache_line_size) cell {
+        std::atomic<std::size_t> seq{0};
+        input_list_type input;
+    };
+
+    template <typename Input>
+    bool try_post(Input &&input) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto &c = m_cells[pos & mask];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff =
+                static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    c.input.template emplace<std::decay_t<Input>>(
+                        std::forward<Input>(input));
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // full
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop_apply() {
+        auto &c = m_cells[m_head & mask];
+
+        if (c.seq.load(std::memory_order_acquire) != m_head + 1) {
+            return false;
+        }
+
+        // release the slot before transit so a throwing error handler
+        // cannot wedge the queue
+        auto input = std::move(c.input);
+        c.input.template emplace<std::monostate>();
+        c.seq.store(m_head + Capacity, std::memory_order_release);
+        ++m_head;
+
+        std::visit(
+            [this](auto &&arg) {
+                using I = std::decay_t<decltype(arg)>;
+                if constexpr (!std::is_same_v<I, std::monostate>) {
+                    m_front.transit(std::move(arg));
+                }
+            },
+            input);
+
+        return true;
+    }
+
+    front_type &m_front;
+    std::unique_ptr<cell[]> m_cells;
+    alignas(cache_line_size) std::atomic<std::size_t> m_tail{0};
+    alignas(cache_line_size) std::size_t m_head{0};
+    // written by producers, away from the consumer line
+    alignas(cache_line_size) std::atomic<std::size_t> m_dropped{0};
+    // read by the consumer thread, only written by start and stop
+    alignas(cache_line_size) std::atomic<bool> m_running{false};
+    std::thread m_consumer;
+};
+}  // namespace lsm
@@ -0,0 +1,490 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <variant>
+#include <vector>
+
+///
+/// Actor runtime for lsm state machines: each machine gets a lock-free
+/// mailbox and is scheduled on a pool of workers with per worker
+/// work-stealing deques. An actor runs on at most one worker at a time
+/// and its mailbox is drained in batches.
+///
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+// schedulable unit of the runtime
+class actor_base {
+   public:
+    virtual ~actor_base() = default;
+
+    // apply up to max inputs, returns the number applied
+    virtual std::size_t drain(std::size_t max) = 0;
+
+    // number of inputs posted and not applied yet, the actor is queued or
+    // running while it is not null
+    std::atomic<std::size_t> mail{0};
+};
+
+// Chase-Lev deque of fixed capacity: the owner pushes and pops at the
+// bottom, thieves steal at the top
+class work_deque {
+   public:
+    explicit work_deque(std::size_t capacity)
+        : m_mask{capacity - 1},
+          m_items{std::make_unique<std::atomic<actor_base *>[]>(capacity)} {}
+
+    // owner only, false if full
+    bool push(actor_base *item) {
+        auto b = m_bottom.load(std::memory_order_relaxed);
+        auto t = m_top.load(std::memory_order_acquire);
+        if (b - t > static_cast<std::int64_t>(m_mask)) {
+            return false;
+        }
+
+        m_items[b & m_mask].store(item, std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // owner only
+    actor_base *pop() {
+        auto b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = m_top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        auto item = m_items[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // last item, race with thieves
+            if (!m_top.compare_exchange_strong(t, t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread
+    actor_base *steal() {
+        auto t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = m_bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+
+        auto item = m_items[t & m_mask].load(std::memory_order_acquire);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+   private:
+    static constexpr std::size_t cache_line_size = 64;
+
+    std::size_t m_mask;
+    std::unique_ptr<std::atomic<actor_base *>[]> m_items;
+    alignas(cache_line_size) std::atomic<std::int64_t> m_top{0};
+    alignas(cache_line_size) std::atomic<std::int64_t> m_bottom{0};
+};
+
+// bounded MPMC queue (Vyukov) of the actors posted from outside the
+// workers, any worker pops from it
+class injection_queue {
+   public:
+    explicit injection_queue(std::size_t capacity)
+        : m_mask{capacity - 1}, m_cells{std::make_unique<cell[]>(capacity)} {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // any thread, false if full
+    bool push(actor_base *item) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto &c = m_cells[pos & m_mask];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos);
+
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    c.item = item;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // any thread, nullptr if empty
+    actor_base *pop() {
+        auto pos = m_head.load(std::memory_order_relaxed);
+
+        for (;;) {
+            auto &c = m_cells[pos & m_mask];
+            auto seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    auto item = c.item;
+                    c.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return item;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // may be stale, for sleeping workers
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) ==
+               m_tail.load(std::memory_order_acquire);
+    }
+
+   private:
+    static constexpr std::size_t cache_line_size = 64;
+
+    struct cell {
+        std::atomic<std::size_t> seq{0};
+        actor_base *item{nullptr};
+    };
+
+    std::size_t m_mask;
+    std::unique_ptr<cell[]> m_cells;
+    alignas(cache_line_size) std::atomic<std::size_t> m_tail{0};
+    alignas(cache_line_size) std::atomic<std::size_t> m_head{0};
+};
+
+// intrusive MPSC queue (Vyukov), one allocation per message
+template <typename Message>
+class mailbox {
+   public:
+    mailbox() = default;
+    mailbox(const mailbox &) = delete;
+    mailbox &operator=(const mailbox &) = delete;
+
+    ~mailbox() {
+        Message msg;
+        while (pop(msg)) {
+        }
+
+        // the last node popped is the tail
+        if (m_tail != &m_stub) {
+            delete m_tail;
+        }
+    }
+
+    // any thread
+    template <typename T>
+    void push(T &&msg) {
+        auto n = new node{std::forward<T>(msg)};
+        auto prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // consumer only, false if empty (or if a push is not linked yet)
+    bool pop(Message &msg) {
+        auto tail = m_tail;
+        auto next = tail->next.load(std::memory_order_acquire);
+
+        if (next == nullptr) {
+            return false;
+        }
+
+        msg = std::move(next->msg);
+        m_tail = next;
+        if (tail != &m_stub) {
+            delete tail;
+        }
+        return true;
+    }
+
+   private:
+    struct node {
+        Message msg;
+        std::atomic<node *> next{nullptr};
+    };
+
+    node m_stub{};
+    std::atomic<node *> m_head{&m_stub};
+    node *m_tail{&m_stub};
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Runtime
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Pool of workers running actors
+///
+/// Actors posted from outside the runtime go through a shared lock-free
+/// injection queue, actors posted from a worker (e.g. from a transition
+/// callback) go to the deque of that worker. Idle workers steal from the
+/// others. A mutex is only taken when both queues are full and to sleep.
+///
+class runtime {
+   public:
+    explicit runtime(std::size_t threads = std::thread::hardware_concurrency(),
+                     std::size_t batch = 64)
+        : m_batch{std::max<std::size_t>(batch, 1)} {
+        threads = std::max<std::size_t>(threads, 1);
+        for (std::size_t w = 0; w < threads; ++w) {
+            m_workers.push_back(std::make_unique<worker>());
+        }
+        for (std::size_t w = 0; w < threads; ++w) {
+            m_workers[w]->thread = std::thread([this, w] { run(w); });
+        }
+    }
+
+    runtime(const runtime &) = delete;
+    runtime &operator=(const runtime &) = delete;
+
+    ~runtime() {
+        m_quit.store(true);
+        {
+            std::lock_guard<std::mutex> lk{m_mutex};
+        }
+        m_wake.notify_all();
+
+        for (auto &w : m_workers) {
+            w->thread.join();
+        }
+    }
+
+    ///
+    /// @brief Wait until every posted input has been applied
+    ///
+    void wait() {
+        while (m_outstanding.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+    std::size_t thread_count() const { return m_workers.size(); }
+
+   private:
+    template <typename>
+    friend class actor;
+
+    static constexpr std::size_t deque_capacity = 1 << 16;
+    static constexpr std::size_t injection_capacity = 1 << 16;
+
+    struct worker {
+        details::work_deque deque{deque_capacity};
+        std::thread thread;
+    };
+
+    // worker running on this thread
+    struct current_worker {
+        runtime *owner{nullptr};
+        std::size_t index{0};
+    };
+
+    static current_worker &current() {
+        static thread_local current_worker cw;
+        return cw;
+    }
+
+    void posted() { m_outstanding.fetch_add(1, std::memory_order_relaxed); }
+
+    void schedule(details::actor_base *a) {
+        auto &cw = current();
+        if ((cw.owner != this || !m_workers[cw.index]->deque.push(a)) &&
+            !m_injected.push(a)) {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            m_overflow.push_back(a);
+            m_overflow_size.fetch_add(1, std::memory_order_release);
+        }
+
+        if (m_sleeping.load() != 0) {
+            m_wake.notify_one();
+        }
+    }
+
+    details::actor_base *find_work(std::size_t w) {
+        if (auto a = m_workers[w]->deque.pop()) {
+            return a;
+        }
+
+        if (auto a = m_injected.pop()) {
+            return a;
+        }
+
+        if (m_overflow_size.load(std::memory_order_acquire) != 0) {
+            std::lock_guard<std::mutex> lk{m_mutex};
+            if (!m_overflow.empty()) {
+                auto a = m_overflow.front();
+                m_overflow.pop_front();
+                m_overflow_size.fetch_sub(1, std::memory_order_relaxed);
+                return a;
+            }
+        }
+
+        for (std::size_t i = 1; i < m_workers.size(); ++i) {
+            auto victim = (w + i) % m_workers.size();
+            if (auto a = m_workers[victim]->deque.steal()) {
+                return a;
+            }
+        }
+        return nullptr;
+    }
+
+    void run(std::size_t w) {
+        current() = {this, w};
+
+        while (!m_quit.load(std::memory_order_relaxed)) {
+            auto a = find_work(w);
+
+            if (a == nullptr) {
+                // short sleeps bound a missed wake up
+                std::unique_lock<std::mutex> lk{m_mutex};
+                ++m_sleeping;
+                m_wake.wait_for(lk, std::chrono::milliseconds(1), [this] {
+                    return m_quit.load() || !m_injected.empty() ||
+                           m_overflow_size.load() != 0;
+                });
+                --m_sleeping;
+                continue;
+            }
+
+            execute(a);
+        }
+    }
+
+    void execute(details::actor_base *a) {
+        auto count =
+            a->drain(std::min(m_batch, a->mail.load(std::memory_order_acquire)));
+
+        // inputs left (batch exhausted, posted meanwhile or not linked yet
+        // in the mailbox), the actor is queued again behind the others
+        if (a->mail.fetch_sub(count, std::memory_order_acq_rel) != count) {
+            schedule(a);
+        }
+
+        // last access to the actor, wait() may return and the actor be
+        // destroyed
+        m_outstanding.fetch_sub(count, std::memory_order_release);
+    }
+
+    std::size_t m_batch;
+    std::vector<std::unique_ptr<worker>> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    details::injection_queue m_injected{injection_capacity};
+    // actors left over by a full injection queue
+    std::deque<details::actor_base *> m_overflow;
+    std::atomic<std::size_t> m_overflow_size{0};
+    std::atomic<std::size_t> m_sleeping{0};
+    std::atomic<std::size_t> m_outstanding{0};
+    std::atomic<bool> m_quit{false};
+};
+
+///
+/// @brief State machine run by a runtime, fed through its mailbox
+///
+/// Inputs may be posted from any thread, including from the transition
+/// callbacks of other actors. The actor must outlive the runtime or have
+/// no input left to apply when destroyed.
+///
+template <typename T>
+class actor : private details::actor_base {
+   public:
+    using front_type = state_machine_front<T>;
+    using input_types = typename front_type::input_types;
+    using input_list_type = list::rebind_t<
+        std::variant, list::push_front_t<std::monostate, input_types>>;
+
+    actor(runtime &rt, front_type &front) : m_runtime{rt}, m_front{front} {}
+
+    template <typename Input>
+    void post(Input &&input) {
+        static_assert(list::has_v<std::decay_t<Input>, input_types>,
+                      "input type does not appear in the transition table");
+
+        m_runtime.posted();
+        m_mailbox.push(input_list_type{std::forward<Input>(input)});
+
+        // counted once linked, the first input schedules the actor
+        if (mail.fetch_add(1, std::memory_order_acq_rel) == 0) {
+            m_runtime.schedule(this);
+        }
+    }
+
+   private:
+    std::size_t drain(std::size_t max) override {
+        std::size_t count = 0;
+        input_list_type input;
+
+        for (; count < max && m_mailbox.pop(input); ++count) {
+            std::visit(
+                [this](auto &arg) {
+                    using I = std::decay_t<decltype(arg)>;
+                    if constexpr (!std::is_same_v<I, std::monostate>) {
+                        m_front.transit(std::move(arg));
+                    }
+                },
+                input);
+        }
+        return count;
+    }
+
+    runtime &m_runtime;
+    front_type &m_front;
+    details::mailbox<input_list_type> m_mailbox;
+};
+}  // namespace lsm
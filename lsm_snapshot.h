@@ -0,0 +1,358 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+///
+/// Binary snapshots of lsm state machines: the current state index of
+/// each machine, followed by the payload of the states that opt in, in a
+/// fixed layout that can be memory mapped and restored machine by machine.
+///
+/// Layout (native byte order):
+///   header | state index of each machine | padding to 8 bytes |
+///   payload slot of each machine
+///
+/// A state opts in by defining:
+///   static constexpr std::size_t serialized_size;
+///   void serialize(std::byte *out) const;
+///   void deserialize(const std::byte *in);
+///
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+template <typename State>
+using serialized_size_t = decltype(State::serialized_size);
+
+template <typename State>
+constexpr std::size_t payload_size() {
+    if constexpr (utilities::is_detected_v<serialized_size_t, State>) {
+        return State::serialized_size;
+    } else {
+        return 0;
+    }
+}
+
+template <typename... States>
+constexpr std::size_t max_payload_size(lsm::list::mplist<States...>) {
+    return std::max({std::size_t{0}, payload_size<States>()...});
+}
+
+template <typename T>
+using snapshot_tag_t = decltype(T::snapshot_tag);
+
+// table structure, then size, alignment and payload size of each state
+// in index order, then the tag of T if any
+template <typename T, typename Table, typename... States>
+constexpr std::uint64_t snapshot_hash(lsm::list::mplist<States...>) {
+    auto hash = table_structure<Table>::hash();
+    ((hash = utilities::fnv1a(
+          utilities::fnv1a(utilities::fnv1a(hash, sizeof(States)),
+                           alignof(States)),
+          payload_size<States>())),
+     ...);
+
+    if constexpr (utilities::is_detected_v<snapshot_tag_t, T>) {
+        hash = utilities::fnv1a(hash,
+                                static_cast<std::uint64_t>(T::snapshot_tag));
+    }
+    return hash;
+}
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Snapshot format
+//--------------------------------------------------------
+
+namespace lsm {
+struct snapshot_header {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t table_hash;
+    std::uint64_t count;
+    std::uint32_t index_size;
+    std::uint32_t payload_size;
+};
+
+///
+/// @brief Layout of the snapshots of machines described by T
+///
+/// Snapshots are versioned with a hash of the structure of the flattened
+/// transition table (state and input counts, source, input and target
+/// indexes of each transition) and of the layout of the states (size,
+/// alignment and payload size of each state in index order). The hash
+/// does not depend on the compiler, a snapshot taken with another table or
+/// other state layouts is rejected. Other changes (e.g. of the meaning of
+/// a payload) are told apart by an optional tag of the descriptor:
+///   static constexpr std::uint64_t snapshot_tag;
+///
+template <typename T>
+struct snapshot_format {
+    using traits_type = traits::state_machine_traits<T>;
+    using state_index_type = typename traits_type::state_index_type;
+
+    static constexpr std::uint32_t magic = 0x534d534c;  // "LSMS"
+    static constexpr std::uint32_t version = 3;
+    static constexpr std::size_t index_size = sizeof(state_index_type);
+    static constexpr std::size_t payload_size =
+        details::max_payload_size(typename traits_type::state_types{});
+
+    static constexpr std::uint64_t table_hash() {
+        return details::snapshot_hash<
+            T, typename traits_type::transition_table_type>(
+            typename traits_type::state_types{});
+    }
+
+    static constexpr std::size_t index_offset() {
+        return sizeof(snapshot_header);
+    }
+
+    static constexpr std::size_t payload_offset(std::size_t count) {
+        return (index_offset() + count * index_size + 7) & ~std::size_t{7};
+    }
+
+    ///
+    /// @brief Size in bytes of the snapshot of count machines
+    ///
+    static constexpr std::size_t size(std::size_t count) {
+        return payload_offset(count) + count * payload_size;
+    }
+};
+
+///
+/// @brief Write the snapshot of count machines in a caller buffer of
+/// snapshot_format<T>::size(count) bytes
+///
+template <typename T>
+class snapshot_writer {
+   public:
+    using format_type = snapshot_format<T>;
+    using state_index_type = typename format_type::state_index_type;
+
+    snapshot_writer(void *buffer, std::size_t count)
+        : m_data{static_cast<std::byte *>(buffer)}, m_count{count} {
+        snapshot_header header{format_type::magic,
+                               format_type::version,
+                               format_type::table_hash(),
+                               count,
+                               format_type::index_size,
+                               format_type::payload_size};
+        std::memcpy(m_data, &header, sizeof(header));
+    }
+
+    ///
+    /// @brief Save machine i
+    ///
+    /// @return false if i is out of range
+    ///
+    bool save(std::size_t i, state_machine_front<T> &front) {
+        if (i >= m_count) {
+            return false;
+        }
+
+        write_index(i, front.index());
+
+        if constexpr (format_type::payload_size != 0) {
+            auto out = m_data + format_type::payload_offset(m_count) +
+                       i * format_type::payload_size;
+            front.visit_state([out](const auto &state) {
+                using S = std::decay_t<decltype(state)>;
+                if constexpr (details::payload_size<S>() != 0) {
+                    state.serialize(out);
+                }
+            });
+        }
+        return true;
+    }
+
+    ///
+    /// @brief Save a collection of machines that only holds state indexes
+    /// (e.g. machine_fleet), machine i of the snapshot is machine id i
+    ///
+    /// @return false if the fleet holds more machines than the snapshot
+    ///
+    template <typename Fleet>
+    bool save_fleet(const Fleet &fleet) {
+        if (fleet.size() > m_count) {
+            return false;
+        }
+
+        for (std::size_t id = 0; id < fleet.size(); ++id) {
+            write_index(id, fleet.index(id));
+        }
+        return true;
+    }
+
+   private:
+    void write_index(std::size_t i, std::size_t index) {
+        auto idx = static_cast<state_index_type>(index);
+        std::memcpy(m_data + format_type::index_offset() + i * sizeof(idx),
+                    &idx, sizeof(idx));
+    }
+
+    std::byte *m_data;
+    std::size_t m_count;
+};
+
+///
+/// @brief Read a snapshot (e.g. a memory mapped file) machine by machine
+///
+/// Only the header is checked on construction, nothing is copied.
+///
+template <typename T>
+class snapshot_reader {
+   public:
+    using format_type = snapshot_format<T>;
+    using state_index_type = typename format_type::state_index_type;
+
+    snapshot_reader(const void *data, std::size_t size)
+        : m_data{static_cast<const std::byte *>(data)} {
+        snapshot_header header{};
+        if (m_data == nullptr || size < sizeof(header)) {
+            return;
+        }
+
+        std::memcpy(&header, m_data, sizeof(header));
+        if (header.magic == format_type::magic &&
+            header.version == format_type::version &&
+            header.table_hash == format_type::table_hash() &&
+            header.index_size == format_type::index_size &&
+            header.payload_size == format_type::payload_size &&
+            header.count <= size && size >= format_type::size(header.count)) {
+            m_count = header.count;
+            m_valid = true;
+        }
+    }
+
+    ///
+    /// @brief False if the snapshot is truncated, stale or not a snapshot
+    /// of machines described by T
+    ///
+    bool valid() const { return m_valid; }
+
+    std::size_t size() const { return m_count; }
+
+    std::size_t index(std::size_t i) const {
+        state_index_type idx;
+        std::memcpy(&idx, m_data + format_type::index_offset() + i * sizeof(idx),
+                    sizeof(idx));
+        return idx;
+    }
+
+    ///
+    /// @brief Restore machine i, state hooks are not called
+    ///
+    /// @return false if the snapshot is not valid
+    ///
+    bool restore(std::size_t i, state_machine_front<T> &front) const {
+        if (!m_valid || i >= m_count) {
+            return false;
+        }
+
+        auto in = m_data + format_type::payload_offset(m_count) +
+                  i * format_type::payload_size;
+        return front.restore_state(index(i), [in](auto &state) {
+            using S = std::decay_t<decltype(state)>;
+            if constexpr (details::payload_size<S>() != 0) {
+                state.deserialize(in);
+            }
+        });
+    }
+
+    ///
+    /// @brief Restore a collection of machines that only holds state
+    /// indexes (e.g. machine_fleet)
+    ///
+    template <typename Fleet>
+    bool restore_fleet(Fleet &fleet) const {
+        if (!m_valid || m_count != fleet.size()) {
+            return false;
+        }
+
+        for (std::size_t id = 0; id < m_count; ++id) {
+            if (!fleet.restore(id, index(id))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+   private:
+    const std::byte *m_data;
+    std::size_t m_count{0};
+    bool m_valid{false};
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+///
+/// @brief Read only memory mapping of a snapshot file
+///
+class mapped_snapshot {
+   public:
+    explicit mapped_snapshot(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *addr = ::mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                                PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                m_data = addr;
+                m_size = static_cast<std::size_t>(st.st_size);
+            }
+        }
+
+        ::close(fd);
+    }
+
+    mapped_snapshot(const mapped_snapshot &) = delete;
+    mapped_snapshot &operator=(const mapped_snapshot &) = delete;
+
+    ~mapped_snapshot() {
+        if (m_data != nullptr) {
+            ::munmap(m_data, m_size);
+        }
+    }
+
+    bool is_open() const { return m_data != nullptr; }
+
+    const void *data() const { return m_data; }
+
+    std::size_t size() const { return m_size; }
+
+   private:
+    void *m_data{nullptr};
+    std::size_t m_size{0};
+};
+#endif
+}  // namespace lsm
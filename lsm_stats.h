@@ -0,0 +1,278 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+///
+/// Transition instrumentation for lsm state machines: hit and rejection
+/// counters per (state, input) and log2 bucketed latency histograms.
+///
+/// By default a single span is timed per transition, from the exit hooks
+/// of the source state to the end of the transition callback. With
+/// stats_detail::hooks, the exit hooks, the enter hooks and the transition
+/// callback are timed apart instead (three spans per transition). The
+/// exit span includes the exit hooks of the composite states left, the
+/// enter span the enter hooks of the composite states reached and the
+/// activation of the new state. Guards are never timed.
+///
+
+//--------------------------------------------------------
+// Snapshot
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Timed code of the transitions
+///
+enum class stats_detail {
+    transition,  ///< one span per transition
+    hooks        ///< exit hooks, enter hooks and callback timed apart
+};
+
+///
+/// @brief Latency histogram, bucket b counts durations in [2^(b-1), 2^b)
+/// nanoseconds (bucket 0 counts null durations, the last one is open)
+///
+struct latency_histogram {
+    static constexpr std::size_t bucket_count = 32;
+
+    std::array<std::uint64_t, bucket_count> buckets{};
+
+    std::uint64_t count() const {
+        std::uint64_t total = 0;
+        for (auto b : buckets) {
+            total += b;
+        }
+        return total;
+    }
+};
+
+struct transition_record {
+    std::string_view state;
+    std::string_view input;
+    std::uint64_t hits{0};
+    std::uint64_t rejected{0};
+    latency_histogram latency;  ///< whole transition (stats_detail::transition)
+    latency_histogram apply;    ///< callback only (stats_detail::hooks)
+};
+
+struct state_record {
+    std::string_view state;
+    latency_histogram enter;
+    latency_histogram exit;
+};
+
+///
+/// @brief Copy of the counters of a state machine
+///
+/// Only the (state, input) pairs that were hit or rejected are listed,
+/// every state is listed with stats_detail::hooks only.
+///
+struct stats_snapshot {
+    std::vector<transition_record> transitions;
+    std::vector<state_record> states;
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+// names of the types of a list, see utilities::type_name
+template <typename... Ts>
+constexpr auto type_names(lsm::list::mplist<Ts...>) {
+    return std::array<std::string_view, sizeof...(Ts)>{
+        utilities::type_name<Ts>()...};
+}
+
+class atomic_histogram {
+   public:
+    void add(std::chrono::nanoseconds d) {
+        m_buckets[bucket(static_cast<std::uint64_t>(d.count()))].fetch_add(
+            1, std::memory_order_relaxed);
+    }
+
+    latency_histogram load() const {
+        latency_histogram h;
+        for (std::size_t b = 0; b < latency_histogram::bucket_count; ++b) {
+            h.buckets[b] = m_buckets[b].load(std::memory_order_relaxed);
+        }
+        return h;
+    }
+
+   private:
+    // bit width of ns, clamped to the last bucket
+    static std::size_t bucket(std::uint64_t ns) {
+#if defined(__clang__) || defined(__GNUC__)
+        std::size_t b =
+            ns != 0 ? 64 - static_cast<std::size_t>(__builtin_clzll(ns)) : 0;
+#else
+        std::size_t b = 0;
+        for (; ns != 0; ns >>= 1) {
+            ++b;
+        }
+#endif
+        return b < latency_histogram::bucket_count
+                   ? b
+                   : latency_histogram::bucket_count - 1;
+    }
+
+    std::array<std::atomic<std::uint64_t>, latency_histogram::bucket_count>
+        m_buckets{};
+};
+
+// counters are allocated once with the machine and updated with relaxed
+// atomics, cells are indexed by state index * input count + input index
+template <typename States, typename Inputs, typename Clock,
+          stats_detail Detail>
+class stats_recorder {
+   public:
+    stats_recorder()
+        : m_latency{std::make_unique<atomic_histogram[]>(cell_count)},
+          m_rejected{std::make_unique<std::atomic<std::uint64_t>[]>(
+              cell_count)},
+          m_enter{std::make_unique<atomic_histogram[]>(hooked_state_count)},
+          m_exit{std::make_unique<atomic_histogram[]>(hooked_state_count)} {}
+
+    using probe = typename Clock::time_point;
+
+    template <probe_kind Kind>
+    probe start() {
+        if constexpr (timed<Kind>()) {
+            return Clock::now();
+        } else {
+            return {};
+        }
+    }
+
+    template <probe_kind Kind>
+    void stop(std::size_t state_index, std::size_t input_index, probe p) {
+        if constexpr (timed<Kind>()) {
+            auto elapsed =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - p);
+
+            if constexpr (Kind == probe_kind::enter) {
+                m_enter[state_index].add(elapsed);
+            } else if constexpr (Kind == probe_kind::exit) {
+                m_exit[state_index].add(elapsed);
+            } else {
+                m_latency[state_index * input_count + input_index].add(
+                    elapsed);
+            }
+        }
+    }
+
+    void rejected(std::size_t state_index, std::size_t input_index) {
+        // inputs that are not in the table are not counted
+        if (input_index < input_count) {
+            m_rejected[state_index * input_count + input_index].fetch_add(
+                1, std::memory_order_relaxed);
+        }
+    }
+
+    stats_snapshot snapshot() const {
+        static constexpr auto state_names = type_names(States{});
+        static constexpr auto input_names = type_names(Inputs{});
+
+        stats_snapshot snap;
+
+        for (std::size_t c = 0; c < cell_count; ++c) {
+            transition_record rec;
+            auto latency = m_latency[c].load();
+            rec.hits = latency.count();
+            rec.rejected = m_rejected[c].load(std::memory_order_relaxed);
+            if constexpr (Detail == stats_detail::hooks) {
+                rec.apply = latency;
+            } else {
+                rec.latency = latency;
+            }
+
+            if (rec.hits != 0 || rec.rejected != 0) {
+                rec.state = state_names[c / input_count];
+                rec.input = input_names[c % input_count];
+                snap.transitions.push_back(rec);
+            }
+        }
+
+        for (std::size_t s = 0; s < hooked_state_count; ++s) {
+            snap.states.push_back(
+                {state_names[s], m_enter[s].load(), m_exit[s].load()});
+        }
+
+        return snap;
+    }
+
+   private:
+    // the transition span, or the hook and callback spans
+    template <probe_kind Kind>
+    static constexpr bool timed() {
+        return (Kind == probe_kind::transition) ==
+               (Detail == stats_detail::transition);
+    }
+
+    static constexpr std::size_t state_count = lsm::list::size_v<States>;
+    static constexpr std::size_t input_count = lsm::list::size_v<Inputs>;
+    static constexpr std::size_t cell_count = state_count * input_count;
+    static constexpr std::size_t hooked_state_count =
+        Detail == stats_detail::hooks ? state_count : 0;
+
+    // whole transitions, or callbacks only
+    std::unique_ptr<atomic_histogram[]> m_latency;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> m_rejected;
+    std::unique_ptr<atomic_histogram[]> m_enter;
+    std::unique_ptr<atomic_histogram[]> m_exit;
+};
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Policies
+//--------------------------------------------------------
+
+namespace lsm::policies {
+///
+/// @brief Count and time transitions with Clock, see
+/// state_machine_front::recorder and stats_recorder::snapshot
+///
+/// Each transition reads the clock twice, or six times with
+/// stats_detail::hooks. A cheaper clock (e.g. based on the time stamp
+/// counter) can be provided to reduce the overhead.
+///
+template <typename Clock, stats_detail Detail = stats_detail::transition>
+struct basic_transition_stats {
+    template <typename States, typename Inputs>
+    using recorder = details::stats_recorder<States, Inputs, Clock, Detail>;
+};
+
+using transition_stats = basic_transition_stats<std::chrono::steady_clock>;
+
+///
+/// @brief Time the exit hooks, the enter hooks and the callback of each
+/// transition apart
+///
+using hook_stats =
+    basic_transition_stats<std::chrono::steady_clock, stats_detail::hooks>;
+}  // namespace lsm::policies
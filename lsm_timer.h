@@ -0,0 +1,330 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+///
+/// State timeouts for lsm state machines: a state declares how long the
+/// machine may stay in it, e.g.
+///   static constexpr std::chrono::seconds timeout{30};
+/// and optionally the input applied when it expires (lsm::timeout by
+/// default):
+///   using timeout_input = my_input;
+///
+/// Entering a state arms its timeout and leaving it cancels it (self
+/// transitions keep the running timeout). A timeout that fires is armed
+/// again while the machine stays in the state, e.g. when the timeout
+/// input self transitions or is rejected. Composite states have no
+/// timeout, only leaf states do. Timeouts of any number of
+/// machines are held by a hierarchical timing wheel, armed and cancelled
+/// in O(1) without allocation, and applied through transit as the wheel
+/// is advanced. A wheel and its machines are used from a single thread.
+///
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+// intrusive list hook
+struct timer_link {
+    timer_link *prev{nullptr};
+    timer_link *next{nullptr};
+};
+
+// timer embedded in a machine, linked in a wheel slot while armed
+struct timer_node : timer_link {
+    std::uint64_t expiry{0};
+    void (*fire)(void *owner){nullptr};
+    void *owner{nullptr};
+
+    bool armed() const { return next != nullptr; }
+
+    void unlink() {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = nullptr;
+    }
+};
+
+template <typename State>
+using timeout_t = decltype(State::timeout);
+
+template <typename State>
+using timeout_input_t = typename State::timeout_input;
+
+template <typename... States>
+constexpr bool has_timeout(lsm::list::mplist<States...>) {
+    return (utilities::is_detected_v<timeout_t, States> || ...);
+}
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Timing wheel
+//--------------------------------------------------------
+
+namespace lsm {
+///
+/// @brief Input applied when the timeout of a state expires
+///
+struct timeout {};
+
+///
+/// @brief Hierarchical timing wheel of 4 levels of 256 slots
+///
+/// A timer due in less than 256 ticks lies in a slot of the first level,
+/// farther timers lie in the coarser levels and are moved down as the
+/// wheel turns (timers farther than 2^32 ticks are moved down as late as
+/// possible and armed again). Arming and cancelling are O(1).
+///
+class timer_wheel {
+   public:
+    timer_wheel() {
+        for (auto &level : m_slots) {
+            for (auto &slot : level) {
+                slot.prev = slot.next = &slot;
+            }
+        }
+    }
+
+    timer_wheel(const timer_wheel &) = delete;
+    timer_wheel &operator=(const timer_wheel &) = delete;
+
+    ///
+    /// @brief Current tick
+    ///
+    std::uint64_t now() const { return m_now; }
+
+    ///
+    /// @brief Number of armed timers
+    ///
+    std::size_t size() const { return m_size; }
+
+    ///
+    /// @brief Arm (or move) a timer, due in ticks ticks (at least one)
+    ///
+    void arm(details::timer_node &node, std::uint64_t ticks) {
+        if (node.armed()) {
+            cancel(node);
+        }
+        node.expiry = m_now + (ticks != 0 ? ticks : 1);
+        insert(node);
+        ++m_size;
+    }
+
+    void cancel(details::timer_node &node) {
+        if (node.armed()) {
+            node.unlink();
+            --m_size;
+        }
+    }
+
+    ///
+    /// @brief Advance the wheel by ticks ticks, firing the timers due
+    ///
+    /// @return number of timers fired
+    ///
+    std::size_t advance(std::uint64_t ticks = 1) {
+        std::size_t fired = 0;
+        for (; ticks != 0; --ticks) {
+            fired += step();
+        }
+        return fired;
+    }
+
+   private:
+    static constexpr std::size_t levels = 4;
+    static constexpr std::size_t slot_bits = 8;
+    static constexpr std::size_t slot_count = std::size_t{1} << slot_bits;
+    static constexpr std::uint64_t slot_mask = slot_count - 1;
+
+    void insert(details::timer_node &node) {
+        constexpr std::uint64_t horizon = std::uint64_t{1}
+                                          << (levels * slot_bits);
+        auto delta = node.expiry - m_now;
+        // beyond the horizon, parked in the last slot reached in time
+        auto due = delta < horizon ? node.expiry : m_now + horizon - 1;
+
+        std::size_t level = 0;
+        while (level + 1 < levels &&
+               (due - m_now) >> ((level + 1) * slot_bits) != 0) {
+            ++level;
+        }
+
+        auto &slot = m_slots[level][(due >> (level * slot_bits)) & slot_mask];
+        node.prev = slot.prev;
+        node.next = &slot;
+        slot.prev->next = &node;
+        slot.prev = &node;
+    }
+
+    // move the timers of a slot to the list of pending, timers still
+    // pending may be cancelled (e.g. from the callbacks of another timer)
+    static void take(details::timer_link &slot,
+                     details::timer_link &pending) {
+        if (slot.next == &slot) {
+            pending.prev = pending.next = &pending;
+            return;
+        }
+
+        pending.next = slot.next;
+        pending.prev = slot.prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        slot.prev = slot.next = &slot;
+    }
+
+    std::size_t step() {
+        ++m_now;
+
+        // timers of the next coarse slot are moved down when a lower
+        // level wraps
+        details::timer_link pending;
+        for (std::size_t level = 1; level < levels; ++level) {
+            if ((m_now & ((std::uint64_t{1} << (level * slot_bits)) - 1)) !=
+                0) {
+                break;
+            }
+
+            take(m_slots[level][(m_now >> (level * slot_bits)) & slot_mask],
+                 pending);
+            while (pending.next != &pending) {
+                auto &node = static_cast<details::timer_node &>(*pending.next);
+                node.unlink();
+                insert(node);
+            }
+        }
+
+        std::size_t fired = 0;
+        take(m_slots[0][m_now & slot_mask], pending);
+        while (pending.next != &pending) {
+            auto &node = static_cast<details::timer_node &>(*pending.next);
+            node.unlink();
+            --m_size;
+
+            // the machine may arm the node again from fire
+            node.fire(node.owner);
+            ++fired;
+        }
+        return fired;
+    }
+
+    std::array<std::array<details::timer_link, slot_count>, levels> m_slots;
+    std::uint64_t m_now{0};
+    std::size_t m_size{0};
+};
+}  // namespace lsm
+
+//--------------------------------------------------------
+// Timer policy
+//--------------------------------------------------------
+
+namespace lsm::details {
+// timeout of the current state of Front, Resolution is the wheel tick
+template <typename Front, typename Resolution>
+class state_timers {
+   public:
+    state_timers() = default;
+    state_timers(const state_timers &) = delete;
+    state_timers &operator=(const state_timers &) = delete;
+
+    ~state_timers() { cancel(); }
+
+    ///
+    /// @brief Arm the state timeouts in wheel (nullptr to stop), to be
+    /// attached before the initial state is set
+    ///
+    void attach(timer_wheel *wheel) {
+        cancel();
+        m_wheel = wheel;
+    }
+
+    ///
+    /// @brief Whether the timeout of the current state is running
+    ///
+    bool armed() const { return m_node.armed(); }
+
+    template <typename State>
+    void rearm(Front &front) {
+        static_assert(!has_timeout(
+                          typename Front::traits_type::composite_types{}),
+                      "composite states cannot have a timeout");
+
+        if constexpr (utilities::is_detected_v<timeout_t, State>) {
+            using input_type =
+                utilities::detected_or_t<lsm::timeout, timeout_input_t,
+                                         State>;
+            static_assert(
+                lsm::list::has_v<input_type, typename Front::input_types>,
+                "timeout input does not appear in the transition table");
+
+            if (m_wheel != nullptr) {
+                constexpr auto ticks =
+                    std::chrono::ceil<Resolution>(State::timeout).count();
+                static_assert(ticks >= 0, "state timeout must be positive");
+
+                m_node.fire = &fire<State, input_type>;
+                m_node.owner = &front;
+                m_wheel->arm(m_node, static_cast<std::uint64_t>(ticks));
+            }
+        } else {
+            cancel();
+        }
+    }
+
+   private:
+    template <typename State, typename Input>
+    static void fire(void *owner) {
+        auto &front = *static_cast<Front *>(owner);
+        front.transit(Input{});
+
+        // still in State (self transition or rejected input), not entered
+        // again, so the timeout runs again from now
+        auto &timers = front.timers();
+        if (!timers.armed() && front.template is<State>()) {
+            timers.template rearm<State>(front);
+        }
+    }
+
+    void cancel() {
+        if (m_wheel != nullptr) {
+            m_wheel->cancel(m_node);
+        }
+    }
+
+    timer_node m_node;
+    timer_wheel *m_wheel{nullptr};
+};
+}  // namespace lsm::details
+
+namespace lsm::policies {
+///
+/// @brief Arm the timeout of each state entered in a timer_wheel
+/// attached with state_machine_front::timers().attach, Resolution is the
+/// duration of a wheel tick
+///
+template <typename Resolution = std::chrono::milliseconds>
+struct state_timeouts {
+    template <typename Front>
+    using timers = details::state_timers<Front, Resolution>;
+};
+}  // namespace lsm::policies
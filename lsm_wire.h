@@ -0,0 +1,288 @@
+// Copyright 2019 Ken Avolic <kenavolic@none.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lsm.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+///
+/// Wire decoder for lsm state machines: tagged binary records are mapped
+/// to the inputs of the transition table at compile time and applied
+/// from a read-only byte view, a whole receive buffer in one pass. Tags
+/// and payload sizes are checked for each record; for small inputs the
+/// decoder runs at about the speed of a hand written switch copying each
+/// payload (reading payloads in place only saves the copy of large ones).
+///
+/// Record layout (native byte order):
+///   tag (uint32) | payload size (uint32) | payload | padding to Align
+///
+/// An input opts in by defining:
+///   static constexpr std::uint32_t wire_tag;
+/// and, unless it is trivially copyable (its payload is then the object
+/// representation, reinterpreted in place when aligned):
+///   static Input decode(const std::byte *payload, std::size_t size);
+///
+
+//--------------------------------------------------------
+// Internal details
+//--------------------------------------------------------
+
+namespace lsm::details {
+template <typename Input>
+using wire_tag_t = decltype(Input::wire_tag);
+
+template <typename Input>
+using wire_decode_t = decltype(
+    Input::decode(std::declval<const std::byte *>(), std::size_t{}));
+
+template <typename Input>
+constexpr bool is_wire_input_v = utilities::is_detected_v<wire_tag_t, Input>;
+
+template <typename Input>
+constexpr std::uint32_t wire_tag_or(std::uint32_t none) {
+    if constexpr (is_wire_input_v<Input>) {
+        return Input::wire_tag;
+    } else {
+        return none;
+    }
+}
+
+template <typename... Inputs>
+constexpr std::size_t wire_input_count(lsm::list::mplist<Inputs...>) {
+    return (std::size_t{0} + ... + std::size_t{is_wire_input_v<Inputs>});
+}
+
+template <typename... Inputs>
+constexpr std::uint32_t max_wire_tag(lsm::list::mplist<Inputs...>) {
+    return std::max({std::uint32_t{0}, wire_tag_or<Inputs>(0)...});
+}
+
+template <typename... Inputs>
+constexpr bool unique_wire_tags(lsm::list::mplist<Inputs...>) {
+    constexpr std::uint32_t none = ~std::uint32_t{0};
+    constexpr std::array<std::uint32_t, sizeof...(Inputs) + 1> tags{
+        wire_tag_or<Inputs>(none)..., none};
+
+    for (std::size_t i = 0; i < sizeof...(Inputs); ++i) {
+        for (std::size_t j = i + 1; j < sizeof...(Inputs); ++j) {
+            if (tags[i] != none && tags[i] == tags[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+}  // namespace lsm::details
+
+//--------------------------------------------------------
+// Wire decoder
+//--------------------------------------------------------
+
+namespace lsm {
+struct wire_record_header {
+    std::uint32_t tag;
+    std::uint32_t size;
+};
+
+///
+/// @brief Apply the tagged records of a byte buffer to a state machine
+///
+/// Records are padded to Align bytes (1 for packed records), so payloads
+/// of inputs aligned on at most Align bytes are read in place when the
+/// buffer itself is aligned. Records with an unknown tag or a payload of
+/// the wrong size are skipped and counted.
+///
+template <typename T, std::size_t Align = 1>
+class wire_decoder {
+    static_assert(Align != 0 && (Align & (Align - 1)) == 0,
+                  "record alignment must be a power of two");
+
+   public:
+    using front_type = state_machine_front<T>;
+    using input_types = typename front_type::input_types;
+
+    static_assert(details::unique_wire_tags(input_types{}),
+                  "two inputs of the transition table share a wire tag");
+
+    explicit wire_decoder(front_type &front) : m_front{front} {}
+
+    ///
+    /// @brief Apply the record at the start of data
+    ///
+    /// @return bytes consumed, 0 if the record is truncated
+    ///
+    std::size_t transit(const void *data, std::size_t size) {
+        return consume(m_front, static_cast<const std::byte *>(data), size,
+                       m_malformed);
+    }
+
+    ///
+    /// @brief Apply every complete record of a buffer in order
+    ///
+    /// @return bytes consumed, a trailing partial record is left for the
+    /// next buffer
+    ///
+    std::size_t transit_buffer(const void *data, std::size_t size) {
+        auto bytes = static_cast<const std::byte *>(data);
+        auto &front = m_front;
+        std::size_t malformed = 0;
+        std::size_t offset = 0;
+
+        // locals are kept in registers across the transition callbacks
+        while (auto used =
+                   consume(front, bytes + offset, size - offset, malformed)) {
+            offset += used;
+        }
+
+        m_malformed += malformed;
+        return offset;
+    }
+
+    std::size_t malformed() const { return m_malformed; }
+
+    ///
+    /// @brief Size of the record of a payload, padding included
+    ///
+    static constexpr std::size_t record_size(std::size_t payload_size) {
+        return (sizeof(wire_record_header) + payload_size + Align - 1) &
+               ~(Align - 1);
+    }
+
+   private:
+    static std::size_t consume(front_type &front, const std::byte *bytes,
+                               std::size_t size, std::size_t &malformed) {
+        wire_record_header header;
+        if (size < sizeof(header)) {
+            return 0;
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+
+        if (header.size > size - sizeof(header)) {
+            return 0;
+        }
+
+        if (!dispatch(front, header.tag, bytes + sizeof(header),
+                      header.size)) {
+            ++malformed;
+        }
+        return std::min(size, record_size(header.size));
+    }
+
+    using handler_type = bool (*)(front_type &, const std::byte *,
+                                  std::size_t);
+
+    static constexpr std::uint32_t max_tag =
+        details::max_wire_tag(input_types{});
+
+    // a few tags are compared inline, many dense tags are looked up in a
+    // jump table
+    static constexpr std::size_t tag_count =
+        details::wire_input_count(input_types{});
+    static constexpr bool dense = tag_count > 8 && max_tag < 4 * tag_count;
+
+    template <typename Input>
+    static bool apply(front_type &front, const std::byte *payload,
+                      std::size_t size) {
+        if constexpr (utilities::is_detected_v<details::wire_decode_t,
+                                               Input>) {
+            front.transit(Input::decode(payload, size));
+        } else {
+            static_assert(std::is_trivially_copyable_v<Input>,
+                          "input without decode function must be trivially "
+                          "copyable");
+
+            if constexpr (std::is_empty_v<Input>) {
+                if (size != 0) {
+                    return false;
+                }
+                front.transit(Input{});
+            } else {
+                if (size != sizeof(Input)) {
+                    return false;
+                }
+
+                if (reinterpret_cast<std::uintptr_t>(payload) %
+                        alignof(Input) ==
+                    0) {
+                    front.transit(*reinterpret_cast<const Input *>(payload));
+                } else {
+                    Input input;
+                    std::memcpy(&input, payload, sizeof(input));
+                    front.transit(input);
+                }
+            }
+        }
+        return true;
+    }
+
+    template <typename... Inputs>
+    static constexpr auto make_handler_table(list::mplist<Inputs...>) {
+        std::array<handler_type, max_tag + 1> table{};
+        (add_handler<Inputs>(table), ...);
+        return table;
+    }
+
+    template <typename Input, typename Table>
+    static constexpr void add_handler(Table &table) {
+        if constexpr (details::is_wire_input_v<Input>) {
+            table[Input::wire_tag] = &apply<Input>;
+        }
+    }
+
+    template <typename Input>
+    static bool dispatch_if(front_type &front, std::uint32_t tag,
+                            const std::byte *payload, std::size_t size,
+                            bool &done) {
+        if constexpr (details::is_wire_input_v<Input>) {
+            if (tag == Input::wire_tag) {
+                done = apply<Input>(front, payload, size);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename... Inputs>
+    static bool dispatch_tag(front_type &front, std::uint32_t tag,
+                             const std::byte *payload, std::size_t size,
+                             list::mplist<Inputs...>) {
+        bool done = false;
+        (dispatch_if<Inputs>(front, tag, payload, size, done) || ...);
+        return done;
+    }
+
+    static bool dispatch(front_type &front, std::uint32_t tag,
+                         const std::byte *payload, std::size_t size) {
+        if constexpr (dense) {
+            static constexpr auto table = make_handler_table(input_types{});
+            if (tag > max_tag || table[tag] == nullptr) {
+                return false;
+            }
+            return table[tag](front, payload, size);
+        } else {
+            return dispatch_tag(front, tag, payload, size, input_types{});
+        }
+    }
+
+    front_type &m_front;
+    std::size_t m_malformed{0};
+};
+}  // namespace lsm
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <iostream>
+#include <string_view>
 #include <vector>
 
 //--------------------------------------------------------
@@ -11,27 +12,20 @@
 
 // static desc of the state machine
 struct controller : lsm::state_machine_desc<controller> {
-  // state
-  struct state1 final : lsm::base_state {
-    virtual void on_enter() override {
-      std::cout << "enter state 1" << std::endl;
-    }
+  // state (hooks are optional and need not be virtual)
+  struct state1 {
+    void on_enter() { std::cout << "enter state 1" << std::endl; }
 
-    virtual void on_exit() override {
-      std::cout << "exit state 1" << std::endl;
-    }
+    void on_exit() { std::cout << "exit state 1" << std::endl; }
   };
 
-  struct state2 final : lsm::base_state {
-    virtual void on_enter() override {
-      std::cout << "enter state 2" << std::endl;
-    }
+  struct state2 {
+    void on_enter() { std::cout << "enter state 2" << std::endl; }
 
-    virtual void on_exit() override {
-      std::cout << "exit state 2" << std::endl;
-    }
+    void on_exit() { std::cout << "exit state 2" << std::endl; }
   };
 
+  // legacy state with virtual no op hooks
   struct state3 final : lsm::base_state {};
 
   // inputs
@@ -43,18 +37,37 @@ struct controller : lsm::state_machine_desc<controller> {
     int val{0};
   };
 
+  struct input22 {
+    int val{0};
+  };
+
+  // guards
+  bool is_positive(const input22 &i) const { return i.val > 0; }
+
   // callbacks
   void on_input21(const input21 &i) {
     std::cout << "callback on input21 called" << std::endl;
     std::cout << "value = " << i.val << std::endl;
   }
 
+  void on_input22(const input22 &i) {
+    std::cout << "guarded callback on input22 called" << std::endl;
+    std::cout << "value = " << i.val << std::endl;
+  }
+
   using me = controller;
   // define transition table
   using transition_table = lsm::transition_table_type<
       transition<state1, input12, state2>,
       transition_cb<state2, input21, state1, &me::on_input21>,
-      transition<state1, input13, state3>>;
+      transition<state1, input13, state3>,
+      // first candidate whose guard passes is taken
+      transition_guard<state2, input22, state1, &me::is_positive,
+                       &me::on_input22>,
+      transition<state2, input22, state2>>;
+
+  // O(1) jump table dispatch (default is lsm::policies::visit_dispatch)
+  using dispatch_policy = lsm::policies::table_dispatch;
 
   using sm_type = lsm::state_machine_front<controller>;
   sm_type state_machine;
@@ -62,6 +75,206 @@ struct controller : lsm::state_machine_desc<controller> {
   controller() : state_machine{*this} {}
 };
 
+// hierarchical state machine, playing is a composite state
+struct player : lsm::state_machine_desc<player> {
+  // inputs
+  struct play {};
+
+  struct pause {};
+
+  struct stop {};
+
+  // states
+  struct stopped {
+    void on_enter() { std::cout << "enter stopped" << std::endl; }
+  };
+
+  struct playing : lsm::state_machine_desc<playing> {
+    struct running {
+      void on_enter() { std::cout << "enter running" << std::endl; }
+    };
+
+    struct paused {
+      void on_enter() { std::cout << "enter paused" << std::endl; }
+    };
+
+    void on_enter() { std::cout << "enter playing" << std::endl; }
+
+    void on_exit() { std::cout << "exit playing" << std::endl; }
+
+    void on_resume(const play &) { ++resumed; }
+
+    int resumed{0};
+
+    using me = playing;
+    // substate transitions, running is the initial substate
+    using transition_table = lsm::transition_table_type<
+        transition<running, pause, paused>,
+        transition_cb<paused, play, running, &me::on_resume>>;
+  };
+
+  // transitions from playing apply to all its substates
+  using transition_table =
+      lsm::transition_table_type<transition<stopped, play, playing>,
+                                 transition<playing, stop, stopped>>;
+
+  using sm_type = lsm::state_machine_front<player>;
+  sm_type state_machine;
+
+  player() : state_machine{*this} {}
+};
+
+// orthogonal regions, link and session states are tracked together
+struct connection : lsm::state_machine_desc<connection> {
+  // link region states
+  struct link_down {};
+
+  struct link_up {
+    void on_enter() { std::cout << "enter link up" << std::endl; }
+
+    void on_exit() { std::cout << "exit link up" << std::endl; }
+  };
+
+  // session region states
+  struct logged_out {};
+
+  struct logged_in {
+    void on_enter() { std::cout << "enter logged in" << std::endl; }
+
+    void on_exit() { std::cout << "exit logged in" << std::endl; }
+  };
+
+  // inputs
+  struct connect {};
+
+  struct disconnect {};
+
+  struct login {};
+
+  using regions = lsm::regions_type<
+      lsm::transition_table_type<transition<link_down, connect, link_up>,
+                                 transition<link_up, disconnect, link_down>>,
+      // disconnect is applied to both regions
+      lsm::transition_table_type<
+          transition<logged_out, login, logged_in>,
+          transition<logged_in, disconnect, logged_out>>>;
+
+  using sm_type = lsm::region_machine_front<connection>;
+  sm_type state_machine;
+
+  connection() : state_machine{*this} {}
+};
+
+// run to completion, inputs raised by callbacks are queued
+struct handshake : lsm::state_machine_desc<handshake> {
+  // states
+  struct idle {};
+
+  struct waiting {
+    void on_enter() { std::cout << "enter waiting" << std::endl; }
+  };
+
+  // inputs
+  struct hello {};
+
+  struct ack {};
+
+  struct data {
+    int val{0};
+  };
+
+  // callbacks
+  void on_hello(const hello &) {
+    // applied once the current transition completes
+    state_machine.transit(ack{});
+  }
+
+  void on_data(const data &d) {
+    std::cout << "data " << d.val << " received" << std::endl;
+  }
+
+  using me = handshake;
+  using transition_table = lsm::transition_table_type<
+      transition_cb<idle, hello, waiting, &me::on_hello>,
+      transition<waiting, ack, idle>,
+      transition_cb<idle, data, idle, &me::on_data>,
+      // data is kept until the handshake is done
+      defer<waiting, data>>;
+
+  // rings of 8 inputs inside the front
+  using event_policy = lsm::policies::queued_events<8>;
+
+  using sm_type = lsm::state_machine_front<handshake>;
+  sm_type state_machine;
+
+  handshake() : state_machine{*this} {}
+};
+
+// version grammar checked at compile time, the front owns the descriptor
+struct version : lsm::state_machine_desc<version> {
+  // states
+  struct major_part {};
+
+  struct minor_part {};
+
+  // inputs
+  struct character {
+    char c{0};
+  };
+
+  int major_number{0};
+  int minor_number{0};
+
+  // guards
+  constexpr bool is_digit(const character &i) const {
+    return i.c >= '0' && i.c <= '9';
+  }
+
+  constexpr bool is_dot(const character &i) const { return i.c == '.'; }
+
+  // callbacks
+  constexpr void on_major(const character &i) {
+    major_number = major_number * 10 + i.c - '0';
+  }
+
+  constexpr void on_minor(const character &i) {
+    minor_number = minor_number * 10 + i.c - '0';
+  }
+
+  using me = version;
+  using transition_table = lsm::transition_table_type<
+      transition_guard<major_part, character, major_part, &me::is_digit,
+                       &me::on_major>,
+      transition_guard<major_part, character, minor_part, &me::is_dot>,
+      transition_guard<minor_part, character, minor_part, &me::is_digit,
+                       &me::on_minor>>;
+
+  using error_policy = lsm::policies::ignore_error;
+};
+
+// major * 100 + minor, -1 if text is not a version
+constexpr int parse_version(std::string_view text) {
+  lsm::constexpr_machine_front<version> sm;
+  sm.init<version::major_part>();
+
+  for (auto c : text) {
+    if (!sm.transit(version::character{c})) {
+      return -1;
+    }
+  }
+
+  if (!sm.is<version::minor_part>()) {
+    return -1;
+  }
+  return sm.desc().major_number * 100 + sm.desc().minor_number;
+}
+
+static_assert(parse_version("1.2") == 102);
+static_assert(parse_version("1.2.3") == -1);
+
+// baked into the binary, no parsing at startup
+constexpr int supported_version = parse_version("2.14");
+
 //--------------------------------------------------------
 // Program option example
 //--------------------------------------------------------
@@ -223,5 +436,39 @@ int main(int argc, char **argv) {
   ctrl.state_machine.init<controller::state2>();
   ctrl.state_machine.transit(controller::input21{666});
 
+  // guarded transitions
+  ctrl.state_machine.transit(controller::input12{});
+  ctrl.state_machine.transit(controller::input22{-1});
+  ctrl.state_machine.transit(controller::input22{1});
+
+  // hierarchical state machine
+  player p;
+  p.state_machine.init<player::stopped>();
+  p.state_machine.transit(player::play{});
+  p.state_machine.transit(player::pause{});
+  p.state_machine.transit(player::play{});
+  p.state_machine.transit(player::stop{});
+
+  // orthogonal regions
+  connection c;
+  c.state_machine.init<connection::link_down, connection::logged_out>();
+  c.state_machine.transit(connection::connect{});
+  c.state_machine.transit(connection::login{});
+  c.state_machine.transit(connection::disconnect{});
+  c.state_machine.transit(connection::connect{});
+  // no transition in the session region, applied to the link region only
+  c.state_machine.transit(connection::disconnect{});
+
+  // run to completion and deferred inputs
+  handshake hs;
+  hs.state_machine.init<handshake::waiting>();
+  hs.state_machine.transit(handshake::data{42});
+  hs.state_machine.transit(handshake::ack{});
+  hs.state_machine.transit(handshake::hello{});
+
+  // constexpr state machine
+  std::cout << "supported version " << supported_version << std::endl;
+  std::cout << "version 3.x " << parse_version("3.x") << std::endl;
+
   return 0;
-}
\ No newline at end of file
+}